@@ -0,0 +1,38 @@
+/**
+ * Counts the heap allocations and peak heap use of compile() on
+ * generated programs.  Nodes come from a per-compile arena, so the
+ * counts should stay well below one per node.
+ */
+
+#include <ctime>
+#include <iostream>
+#include "BenchPrologue.h"
+
+
+static void benchmark(const char* name, SourceBuilder build,
+                      size_t first, size_t last) {
+    std::cout << name << "\n";
+    for (size_t size = first; size <= last; size *= 2) {
+        string source = build(size);
+
+        size_t baseBytes = liveBytes;
+        allocations = 0;
+        peakBytes = liveBytes;
+
+        clock_t start = clock();
+        CompileResult cr = compile(source);
+        double seconds = double(clock() - start) / CLOCKS_PER_SEC;
+
+        std::cout << "  " << size << ": "
+                  << allocations << " allocations, "
+                  << (peakBytes - baseBytes) / 1024 << " KiB peak, "
+                  << seconds * 1000 << " ms"
+                  << (cr.success ? "" : " (failed)") << "\n";
+    }
+}
+
+
+int main() {
+    benchmark("chain",  makeChain,          64, 512);
+    benchmark("nested", makeUnsharedNested, 4,  32);
+}
@@ -0,0 +1,88 @@
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include "BenchPrologue.h"
+
+
+size_t allocations = 0;
+size_t liveBytes = 0;
+size_t peakBytes = 0;
+
+
+// Every heap block remembers its size, so delete can track live bytes.
+union Header {
+    size_t size;
+    long double align;
+};
+
+
+void* operator new(size_t size) {
+    Header* h = static_cast<Header*>(malloc(sizeof(Header) + size));
+    if (!h) {
+        throw std::bad_alloc();
+    }
+    h->size = size;
+
+    ++allocations;
+    liveBytes += size;
+    if (liveBytes > peakBytes) {
+        peakBytes = liveBytes;
+    }
+    return h + 1;
+}
+
+
+void operator delete(void* p) throw() {
+    if (p) {
+        Header* h = static_cast<Header*>(p) - 1;
+        liveBytes -= h->size;
+        free(h);
+    }
+}
+
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+
+void operator delete[](void* p) throw() {
+    operator delete(p);
+}
+
+
+string makeChain(size_t size) {
+    std::ostringstream os;
+    os << "d0 = gl_Vertex.y\n";
+    for (size_t i = 1; i <= size; ++i) {
+        os << "d" << i << " = d" << i - 1 << " * 0.5 + gl_Vertex.y\n";
+    }
+    os << "gl_Position = vec4 d" << size << " 0.0 0.0 1.0\n";
+    return os.str();
+}
+
+
+string makeNested(size_t size) {
+    std::ostringstream os;
+    os << "h0 x = x * x\n";
+    for (size_t i = 1; i <= size; ++i) {
+        os << "h" << i << " x = h" << i - 1 << " x * h" << i - 1
+           << " x + x\n";
+    }
+    os << "gl_Position = vec4 (h" << size << " gl_Vertex.x)"
+       << " 0.0 0.0 1.0\n";
+    return os.str();
+}
+
+
+string makeUnsharedNested(size_t size) {
+    std::ostringstream os;
+    os << "h0 x = x * x\n";
+    for (size_t i = 1; i <= size; ++i) {
+        os << "h" << i << " x = h" << i - 1 << " x + h" << i - 1
+           << " (x + 1.0)\n";
+    }
+    os << "gl_Position = vec4 (h" << size << " gl_Vertex.x)"
+       << " 0.0 0.0 1.0\n";
+    return os.str();
+}
@@ -0,0 +1,34 @@
+#ifndef BENCH_PROLOGUE_H
+#define BENCH_PROLOGUE_H
+
+
+#include <ren/Compiler.h>
+using namespace ren;
+
+
+/**
+ * Heap use since the program started.  BenchPrologue.cpp replaces
+ * operator new to count it, so benchmarks that read these must link
+ * it in.
+ */
+extern size_t allocations;
+extern size_t liveBytes;
+extern size_t peakBytes;
+
+
+typedef string (*SourceBuilder)(size_t size);
+
+/// d(i) = d(i-1) * 0.5 + gl_Vertex.y: a long chain of definitions.
+string makeChain(size_t size);
+
+/// h0 x = x * x;  h(i) x = h(i-1) x * h(i-1) x + x: helpers nested
+/// size deep, whose two calls share one value.
+string makeNested(size_t size);
+
+/// h0 x = x * x;  h(i) x = h(i-1) x + h(i-1) (x + 1.0): like
+/// makeNested, but the calls take different arguments, so nothing is
+/// shared.
+string makeUnsharedNested(size_t size);
+
+
+#endif
@@ -0,0 +1,116 @@
+/**
+ * Compares walking a code graph with a dynamic_cast cascade, as the
+ * compiler's traversals used to, against switching on getKind().
+ */
+
+#include <ctime>
+#include <iostream>
+#include <ren/CodeNode.h>
+using namespace ren;
+
+
+static CodeNodePtr makeName(const string& name) {
+    return CodeNodePtr(new NameCodeNode(
+                           name, FLOAT, UNIFORM, NullValue,
+                           ValueNode::UNIFORM));
+}
+
+
+static CodeNodePtr makeAdd(CodeNodePtr lhs, CodeNodePtr rhs) {
+    CodeNodeList args(2);
+    args[0] = lhs;
+    args[1] = rhs;
+    return CodeNodePtr(new CallCodeNode(
+                           FLOAT, FunctionNode::INFIX, "+", args, LINEAR));
+}
+
+
+/// A complete binary tree of additions, with if nodes mixed in.
+static CodeNodePtr makeTree(size_t depth) {
+    if (depth == 0) {
+        return makeName("u");
+    }
+    CodeNodePtr lhs = makeTree(depth - 1);
+    CodeNodePtr rhs = makeTree(depth - 1);
+    if (depth % 3 == 0) {
+        return CodeNodePtr(new IfCodeNode(FLOAT, makeName("c"), lhs, rhs));
+    }
+    return makeAdd(lhs, rhs);
+}
+
+
+/// Counts names, the way the traversals used to tell nodes apart.
+static size_t countByCast(const CodeNodePtr& node) {
+    if (REN_DYNAMIC_CAST_PTR(p, CallCodeNode, node)) {
+        const CodeNodeList& args = p->getChildren();
+        size_t rv = 0;
+        for (size_t i = 0; i < args.size(); ++i) {
+            rv += countByCast(args[i]);
+        }
+        return rv;
+    } else if (REN_DYNAMIC_CAST_PTR(p, IfCodeNode, node)) {
+        const CodeNodeList& args = p->getChildren();
+        size_t rv = 0;
+        for (size_t i = 0; i < args.size(); ++i) {
+            rv += countByCast(args[i]);
+        }
+        return rv;
+    } else if (REN_DYNAMIC_CAST_PTR(p, NameCodeNode, node)) {
+        return 1;
+    } else {
+        assert(!"Unknown code node type");
+        return 0;
+    }
+}
+
+
+/// Counts names, the way the traversals do now.
+static size_t countByKind(const CodeNodePtr& node) {
+    switch (node->getKind()) {
+        case CodeNode::CALL_CODE_NODE:
+        case CodeNode::IF_CODE_NODE: {
+            const CodeNodeList& args = node->getChildren();
+            size_t rv = 0;
+            for (size_t i = 0; i < args.size(); ++i) {
+                rv += countByKind(args[i]);
+            }
+            return rv;
+        }
+
+        case CodeNode::NAME_CODE_NODE:
+            return 1;
+
+        default:
+            assert(!"Unknown code node type");
+            return 0;
+    }
+}
+
+
+typedef size_t (*Walker)(const CodeNodePtr& node);
+
+
+static void benchmark(const char* name, Walker walk, const CodeNodePtr& root,
+                      size_t nodes, size_t repeat) {
+    size_t names = 0;
+    clock_t start = clock();
+    for (size_t r = 0; r < repeat; ++r) {
+        names += walk(root);
+    }
+    double seconds = double(clock() - start) / CLOCKS_PER_SEC;
+
+    std::cout << "  " << name << ": "
+              << seconds * 1e9 / (nodes * repeat) << " ns/node"
+              << " (" << names / repeat << " names)\n";
+}
+
+
+int main() {
+    const size_t depth = 16;
+    const size_t nodes = (size_t(1) << (depth + 1)) - 1;
+    CodeNodePtr root = makeTree(depth);
+
+    std::cout << nodes << " nodes\n";
+    benchmark("dynamic_cast", countByCast, root, nodes, 20);
+    benchmark("kind switch ", countByKind, root, nodes, 20);
+}
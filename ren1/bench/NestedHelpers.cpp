@@ -0,0 +1,39 @@
+/**
+ * Times compile() on helpers that each call the one before twice.
+ * Without shared substitution the work doubles with every level.
+ */
+
+#include <ctime>
+#include <iostream>
+#include <sstream>
+#include <ren/Compiler.h>
+using namespace ren;
+
+
+/// h0 x = x * x;  h(i) x = h(i-1) x + h(i-1) (x + 1.0)
+static string makeSource(size_t depth) {
+    std::ostringstream os;
+    os << "h0 x = x * x\n";
+    for (size_t i = 1; i <= depth; ++i) {
+        os << "h" << i << " x = h" << i - 1 << " x + h" << i - 1
+           << " (x + 1.0)\n";
+    }
+    os << "gl_Position = vec4 (h" << depth << " gl_Vertex.x)"
+       << " 0.0 0.0 1.0\n";
+    return os.str();
+}
+
+
+int main() {
+    for (size_t depth = 4; depth <= 32; depth *= 2) {
+        string source = makeSource(depth);
+
+        clock_t start = clock();
+        CompileResult cr = compile(source);
+        double seconds = double(clock() - start) / CLOCKS_PER_SEC;
+
+        std::cout << "depth " << depth << ": "
+                  << seconds * 1000 << " ms"
+                  << (cr.success ? "" : " (failed)") << "\n";
+    }
+}
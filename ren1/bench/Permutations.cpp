@@ -0,0 +1,101 @@
+/**
+ * Compiles every permutation of a program's constant switches with
+ * compilePermutations, on one thread and then on more, and reports
+ * the speedup.  Wall time, since the point is to use more cores.
+ *
+ * usage: benchPermutations [switches [threads]]
+ *
+ * threads defaults to the number of cores.
+ */
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <boost/thread/thread.hpp>
+#include <ren/Permutations.h>
+using namespace ren;
+
+
+static double now() {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return double(counter.QuadPart) / frequency.QuadPart;
+#else
+    timeval tv;
+    gettimeofday(&tv, 0);
+    return tv.tv_sec + tv.tv_usec * 1e-6;
+#endif
+}
+
+
+/// Each switch picks between two ways of shading one term of a sum.
+static string makeSwitches(size_t switches) {
+    std::ostringstream os;
+    for (size_t i = 0; i < switches; ++i) {
+        os << "constant bool b" << i << "\n";
+    }
+    os << "n = normalize gl_Normal\n";
+    os << "c0 = gl_Color\n";
+    for (size_t i = 1; i <= switches; ++i) {
+        os << "c" << i << " = c" << i - 1 << " + (if b" << i - 1
+           << " then (c" << i - 1 << " * (dot n gl_Vertex.xyz))"
+           << " else (c" << i - 1 << " * " << i << ".0))\n";
+    }
+    os << "gl_Position = ftransform\n";
+    os << "gl_FragColor = c" << switches << "\n";
+    return os.str();
+}
+
+
+int main(int argc, char** argv) {
+    size_t switches = (argc > 1 ? atoi(argv[1]) : 8);
+
+    ProgramPtr program = parse(makeSwitches(switches));
+    std::vector<string> names;
+    for (size_t i = 0; i < switches; ++i) {
+        std::ostringstream name;
+        name << "b" << i;
+        names.push_back(name.str());
+    }
+    ConstantMapList permutations = getBoolPermutations(names);
+
+    unsigned cores = std::max(1u, boost::thread::hardware_concurrency());
+    unsigned maxThreads = (argc > 2 ? atoi(argv[2]) : cores);
+    std::cout << permutations.size() << " permutations, "
+              << cores << " cores\n";
+
+    double serial = 0;
+    for (unsigned threads = 1; ; threads *= 2) {
+        threads = std::min(threads, maxThreads);
+
+        double start = now();
+        std::vector<CompileResult> results = compilePermutations(
+            program, permutations, CompileOptions(), threads);
+        double seconds = now() - start;
+
+        for (size_t i = 0; i < results.size(); ++i) {
+            if (!results[i].success) {
+                std::cerr << "Permutation " << i << " failed\n";
+                return EXIT_FAILURE;
+            }
+        }
+
+        if (threads == 1) {
+            serial = seconds;
+        }
+        std::cout << "  " << threads << " threads: "
+                  << seconds * 1000 << " ms, "
+                  << serial / seconds << "x\n";
+
+        if (threads >= maxThreads) {
+            break;
+        }
+    }
+}
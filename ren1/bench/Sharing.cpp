@@ -0,0 +1,108 @@
+/**
+ * Times GLSLShader::generate on synthetic code graphs of growing size.
+ * Sharing should scale linearly: time per node stays flat as the graph
+ * grows.
+ */
+
+#include <algorithm>
+#include <ctime>
+#include <iostream>
+#include <ren/GLSLShader.h>
+using namespace ren;
+
+
+static CodeNodePtr makeAdd(CodeNodePtr lhs, CodeNodePtr rhs) {
+    CodeNodeList args(2);
+    args[0] = lhs;
+    args[1] = rhs;
+    return CodeNodePtr(new CallCodeNode(
+                           FLOAT, FunctionNode::INFIX, "+", args, LINEAR));
+}
+
+
+static CodeNodePtr makeVec4(const CodeNodeList& args) {
+    return CodeNodePtr(new CallCodeNode(
+                           VEC4, FunctionNode::FUNCTION, "vec4", args,
+                           LINEAR));
+}
+
+
+static CodeNodePtr makeInput(const string& name) {
+    return CodeNodePtr(new NameCodeNode(
+                           name, FLOAT, UNIFORM, NullValue,
+                           ValueNode::UNIFORM));
+}
+
+
+/// x[i+1] = x[i] + x[i]: every node is shared.
+static CodeNodePtr makeChain(size_t size) {
+    CodeNodePtr x = makeInput("u");
+    for (size_t i = 0; i < size; ++i) {
+        x = makeAdd(x, x);
+    }
+    return makeVec4(CodeNodeList(4, x));
+}
+
+
+/// Each node adds two pseudo-random earlier nodes.
+static CodeNodePtr makeLattice(size_t size) {
+    CodeNodeList nodes;
+    nodes.push_back(makeInput("u0"));
+    nodes.push_back(makeInput("u1"));
+
+    unsigned seed = 1;
+    for (size_t i = 0; i < size; ++i) {
+        seed = seed * 1103515245 + 12345;
+        size_t a = nodes.size() - 1 - (seed >> 16) % std::min<size_t>(nodes.size(), 8);
+        seed = seed * 1103515245 + 12345;
+        size_t b = (seed >> 16) % nodes.size();
+        nodes.push_back(makeAdd(nodes[a], nodes[b]));
+    }
+
+    CodeNodeList args(nodes.end() - 4, nodes.end());
+    return makeVec4(args);
+}
+
+
+/// One shared node read by every other node.
+static CodeNodePtr makeFan(size_t size) {
+    CodeNodePtr shared = makeAdd(makeInput("u0"), makeInput("u1"));
+    CodeNodePtr x = makeInput("u2");
+    for (size_t i = 0; i < size; ++i) {
+        x = makeAdd(makeAdd(x, shared), makeInput("u3"));
+    }
+    return makeVec4(CodeNodeList(4, x));
+}
+
+
+typedef CodeNodePtr (*GraphBuilder)(size_t size);
+
+
+static void benchmark(const char* name, GraphBuilder build) {
+    std::cout << name << "\n";
+    for (size_t size = 1250; size <= 10000; size *= 2) {
+        GLSLShader vs;
+        AssignmentPtr s(new Assignment);
+        s->define = false;
+        s->lhs = "gl_Position";
+        s->setExpression(build(size));
+        vs.main->statements.push_back(s);
+
+        string glsl;
+        StringSink sink(glsl);
+        clock_t start = clock();
+        vs.generate(sink);
+        double seconds = double(clock() - start) / CLOCKS_PER_SEC;
+
+        std::cout << "  " << size << " nodes: "
+                  << seconds * 1000 << " ms, "
+                  << seconds * 1e6 / size << " us/node\n";
+    }
+}
+
+
+int main() {
+    benchmark("chain",   makeChain);
+    benchmark("lattice", makeLattice);
+    benchmark("fan",     makeFan);
+}
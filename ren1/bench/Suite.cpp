@@ -0,0 +1,423 @@
+/**
+ * The compile-time benchmark suite.  Compiles synthetic programs that
+ * grow along one axis each, plus the example programs named on the
+ * command line, and reports time per phase, heap allocations and peak
+ * heap use for each.
+ *
+ * usage: benchSuite [--baseline FILE] [--save FILE] [--threshold PERCENT]
+ *                   [--max-exponent E] [--lenient] [program.rs ...]
+ *
+ * --save writes the results as a baseline.  --baseline compares them
+ * with a saved one and fails if any case got slower or bigger by more
+ * than the threshold, or if the baseline can't be read.
+ *
+ * Independently of baselines, an axis fails if any phase that takes a
+ * tenth of its time grows faster than size^E between its two largest
+ * sizes, which catches super-linear passes on any machine.  A jump
+ * only counts if it shows up in every one of several measurements.
+ * With --lenient, jumps are reported but don't fail the suite.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+#include "BenchPrologue.h"
+
+
+/// One value read by every term of a wide sum.
+static string makeFan(size_t size) {
+    std::ostringstream os;
+    os << "s = gl_Vertex.x * gl_Vertex.y\n";
+    os << "sum = s";
+    for (size_t i = 1; i <= size; ++i) {
+        os << " + s * " << i << ".0";
+    }
+    os << "\n";
+    os << "gl_Position = vec4 sum 0.0 0.0 1.0\n";
+    return os.str();
+}
+
+
+/// d(i) = if b(i) then d(i-1) * 2.0 else d(i-1) + 1.0, where b(i)
+/// are constant switches or uniforms.
+static string makeConditionals(size_t size, const char* condition) {
+    std::ostringstream os;
+    for (size_t i = 1; i <= size; ++i) {
+        os << condition << " bool b" << i << "\n";
+    }
+    os << "d0 = gl_Vertex.y\n";
+    for (size_t i = 1; i <= size; ++i) {
+        os << "d" << i << " = if b" << i
+           << " then (d" << i - 1 << " * 2.0)"
+           << " else (d" << i - 1 << " + 1.0)\n";
+    }
+    os << "gl_Position = vec4 d" << size << " 0.0 0.0 1.0\n";
+    return os.str();
+}
+
+
+static string makeSwitches(size_t size) {
+    return makeConditionals(size, "constant");
+}
+
+
+static string makeIfs(size_t size) {
+    return makeConditionals(size, "uniform");
+}
+
+
+/// The sum of many uniforms.
+static string makeUniforms(size_t size) {
+    std::ostringstream os;
+    for (size_t i = 0; i < size; ++i) {
+        os << "uniform float u" << i << "\n";
+    }
+    os << "s0 = u0\n";
+    for (size_t i = 1; i < size; ++i) {
+        os << "s" << i << " = s" << i - 1 << " + u" << i << "\n";
+    }
+    os << "gl_Position = ftransform\n";
+    os << "gl_FragColor = vec4 s" << size - 1 << " 0.0 0.0 1.0\n";
+    return os.str();
+}
+
+
+struct Axis {
+    const char* name;
+    SourceBuilder build;
+    size_t first;
+    size_t last;
+};
+
+static const Axis axes[] = {
+    { "chain",    makeChain,    64, 512  },
+    { "fan",      makeFan,      64, 1024 },
+    { "nested",   makeNested,   8,  64   },
+    { "switches", makeSwitches, 32, 256  },
+    { "ifs",      makeIfs,      8,  64   },
+    { "uniforms", makeUniforms, 64, 512  },
+};
+
+
+struct Measurement {
+    Measurement()
+    : seconds(0)
+    , allocations(0)
+    , peakKiB(0)
+    , success(true) {
+    }
+
+    double seconds;
+    size_t allocations;
+    size_t peakKiB;
+    bool success;
+    CompileStats stats;
+};
+
+
+/// Keeps the faster of each time.
+static void keepFastest(Measurement& best, const Measurement& m) {
+    best.seconds = std::min(best.seconds, m.seconds);
+    for (size_t p = 0; p < CompileStats::PHASE_COUNT; ++p) {
+        best.stats.seconds[p] = std::min(best.stats.seconds[p],
+                                         m.stats.seconds[p]);
+    }
+}
+
+
+/// Best time of several compiles, phase by phase, and the heap use of
+/// one.
+static Measurement measure(const string& source) {
+    Measurement rv;
+    std::ostringstream errors;
+
+    size_t baseBytes = liveBytes;
+    allocations = 0;
+    peakBytes = liveBytes;
+    rv.success = compile(source, errors, &rv.stats).success;
+    rv.allocations = allocations;
+    rv.peakKiB = (peakBytes - baseBytes) / 1024;
+    rv.seconds = rv.stats.getTotalSeconds();
+
+    if (!rv.success) {
+        std::cout << errors.str();
+        return rv;
+    }
+
+    // Repeat for at least a quarter second, keeping the fastest.
+    double spent = rv.seconds;
+    for (size_t i = 0; i < 200 && spent < 0.25; ++i) {
+        Measurement m;
+        compile(source, std::cerr, &m.stats);
+        m.seconds = m.stats.getTotalSeconds();
+        spent += m.seconds;
+        keepFastest(rv, m);
+    }
+    return rv;
+}
+
+
+/// Measures two programs in turns, so a slow spell of the machine
+/// slows both alike.
+static void measureInTurns(const string& a, const string& b,
+                           Measurement& ma, Measurement& mb) {
+    ma = measure(a);
+    mb = measure(b);
+    for (size_t i = 0; i < 2; ++i) {
+        keepFastest(ma, measure(a));
+        keepFastest(mb, measure(b));
+    }
+}
+
+
+static void printHeader() {
+    std::cout << std::setw(16) << std::left << "case" << std::right
+              << std::setw(10) << "ms"
+              << std::setw(10) << "allocs"
+              << std::setw(10) << "peak KiB";
+    for (size_t i = 0; i < CompileStats::PHASE_COUNT; ++i) {
+        string name = CompileStats::getPhaseName(CompileStats::Phase(i));
+        std::cout << std::setw(10) << name.substr(0, 8);
+    }
+    std::cout << "\n";
+}
+
+
+static void print(const string& name, const Measurement& m) {
+    std::cout << std::setw(16) << std::left << name << std::right
+              << std::fixed << std::setprecision(3)
+              << std::setw(10) << m.seconds * 1000
+              << std::setw(10) << m.allocations
+              << std::setw(10) << m.peakKiB;
+    for (size_t i = 0; i < CompileStats::PHASE_COUNT; ++i) {
+        std::cout << std::setw(10) << m.stats.seconds[i] * 1000;
+    }
+    std::cout << (m.success ? "" : "  (failed)") << "\n";
+}
+
+
+typedef std::map<string, Measurement> Results;
+
+
+/// False if the file can't be opened.
+static bool loadBaseline(const string& filename, Results& baseline) {
+    std::ifstream is(filename.c_str());
+    if (!is) {
+        return false;
+    }
+
+    string name;
+    Measurement m;
+    while (is >> name >> m.seconds >> m.allocations >> m.peakKiB) {
+        baseline[name] = m;
+    }
+    return true;
+}
+
+
+static void saveBaseline(const string& filename, const Results& results) {
+    std::ofstream os(filename.c_str());
+    Results::const_iterator i = results.begin();
+    for (; i != results.end(); ++i) {
+        os << i->first << " " << i->second.seconds << " "
+           << i->second.allocations << " " << i->second.peakKiB << "\n";
+    }
+}
+
+
+/// True if now is worse than before by more than threshold.
+static bool regressed(const char* what, const string& name,
+                      double before, double now, double threshold) {
+    if (before > 0 && now > before * (1 + threshold)) {
+        std::cout << "REGRESSION: " << name << " " << what << " "
+                  << before << " -> " << now << "\n";
+        return true;
+    }
+    return false;
+}
+
+
+static bool compare(const Results& baseline, const Results& results,
+                    double threshold) {
+    bool ok = true;
+    Results::const_iterator i = results.begin();
+    for (; i != results.end(); ++i) {
+        Results::const_iterator b = baseline.find(i->first);
+        if (b == baseline.end()) {
+            continue;
+        }
+        const Measurement& before = b->second;
+        const Measurement& now = i->second;
+        ok &= !regressed("ms", i->first,
+                         before.seconds * 1000, now.seconds * 1000,
+                         threshold);
+        ok &= !regressed("allocations", i->first,
+                         before.allocations, now.allocations, threshold);
+        ok &= !regressed("peak KiB", i->first,
+                         before.peakKiB, now.peakKiB, threshold);
+    }
+    return ok;
+}
+
+
+/// Time for twice the size should be about twice the time.  Writes
+/// the phases that grow faster if report is set.
+static bool checkGrowth(const char* axis, const Measurement& before,
+                        const Measurement& after, double maxExponent,
+                        bool report) {
+    bool ok = true;
+    for (size_t i = 0; i < CompileStats::PHASE_COUNT; ++i) {
+        double t0 = before.stats.seconds[i];
+        double t1 = after.stats.seconds[i];
+        if (t0 <= 0 || t1 < after.seconds / 10) {
+            continue;
+        }
+
+        double exponent = log(t1 / t0) / log(2.0);
+        if (exponent > maxExponent) {
+            if (report) {
+                std::cout << "SUPER-LINEAR: " << axis << " "
+                          << CompileStats::getPhaseName(
+                              CompileStats::Phase(i))
+                          << " grows as size^" << exponent << "\n";
+            }
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+
+/**
+ * Measures an axis's two largest sizes again, in turns, a few times.
+ * A stall in any one measurement can fake a jump, so the axis only
+ * fails if every round shows one.  Reports the last round's jumps.
+ */
+static bool confirmGrowth(const Axis& axis, double maxExponent) {
+    const size_t rounds = 3;
+    string small = axis.build(axis.last / 2);
+    string large = axis.build(axis.last);
+    for (size_t i = 0; i < rounds; ++i) {
+        Measurement before, after;
+        measureInTurns(small, large, before, after);
+        if (checkGrowth(axis.name, before, after, maxExponent,
+                        i + 1 == rounds)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static bool readFile(const string& filename, string& contents) {
+    std::ifstream is(filename.c_str());
+    if (!is) {
+        return false;
+    }
+
+    std::ostringstream os;
+    os << is.rdbuf();
+    contents = os.str();
+    return true;
+}
+
+
+/// brick.rs for examples/brick.rs.
+static string baseName(const string& filename) {
+    string::size_type slash = filename.find_last_of("/\\");
+    string rv = (slash == string::npos ? filename : filename.substr(slash + 1));
+    return rv.substr(0, rv.rfind('.'));
+}
+
+
+int main(int argc, char** argv) {
+    string baselineFile;
+    string saveFile;
+    double threshold = 0.25;
+    double maxExponent = 1.5;
+    bool lenient = false;
+    std::vector<string> programs;
+
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--baseline" && i + 1 < argc) {
+            baselineFile = argv[++i];
+        } else if (arg == "--save" && i + 1 < argc) {
+            saveFile = argv[++i];
+        } else if (arg == "--threshold" && i + 1 < argc) {
+            threshold = atof(argv[++i]) / 100;
+        } else if (arg == "--max-exponent" && i + 1 < argc) {
+            maxExponent = atof(argv[++i]);
+        } else if (arg == "--lenient") {
+            lenient = true;
+        } else {
+            programs.push_back(arg);
+        }
+    }
+
+    // Build the compiler's tables before anything is measured.
+    compile("gl_Position = ftransform\n");
+
+    bool ok = true;
+    Results results;
+    printHeader();
+
+    for (size_t a = 0; a < sizeof(axes) / sizeof(*axes); ++a) {
+        const Axis& axis = axes[a];
+        Measurement previous;
+        for (size_t size = axis.first; size <= axis.last; size *= 2) {
+            std::ostringstream name;
+            name << axis.name << "/" << size;
+
+            Measurement m = measure(axis.build(size));
+            print(name.str(), m);
+            results[name.str()] = m;
+            ok &= m.success;
+
+            if (size == axis.last &&
+                !checkGrowth(axis.name, previous, m, maxExponent, false)
+            ) {
+                bool linear = confirmGrowth(axis, maxExponent);
+                ok &= linear || lenient;
+            }
+            previous = m;
+        }
+    }
+
+    for (size_t i = 0; i < programs.size(); ++i) {
+        string source;
+        if (!readFile(programs[i], source)) {
+            std::cout << "Can't read " << programs[i] << "\n";
+            ok = false;
+            continue;
+        }
+        string name = baseName(programs[i]);
+        Measurement m = measure(source);
+        print(name, m);
+        results[name] = m;
+        ok &= m.success;
+    }
+
+    if (!baselineFile.empty()) {
+        Results baseline;
+        if (!loadBaseline(baselineFile, baseline) || baseline.empty()) {
+            std::cout << "No baseline in " << baselineFile << "\n";
+            ok = false;
+        } else {
+            ok &= compare(baseline, results, threshold);
+        }
+    }
+
+    if (!saveFile.empty()) {
+        saveBaseline(saveFile, results);
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -3,15 +3,19 @@
 
 
 #include <fstream>
+#include <map>
 #include <stdexcept>
 #include <string>
 
 #include <boost/scoped_array.hpp>
+#include <boost/weak_ptr.hpp>
 #include <SDL.h>
 #include "glew.h"
 
 #include <ren/Compiler.h>
 #include <ren/Input.h>
+#include <ren/VariantCache.h>
+#include <ren/VariantSelector.h>
 
 
 inline void throwSDLError(const std::string& prefix) {
@@ -63,10 +67,38 @@ void loadShader(GLhandleARB shader, const std::string& source) {
 }
 
 
+/// Shared by every shader, so compiles never run on the drawing thread.
+inline ren::CompileQueue& getCompileQueue() {
+    static ren::CompileQueue queue;
+    return queue;
+}
+
+
+inline ren::CompileOptions getCompileOptions() {
+    ren::CompileOptions options;
+    options.packUniforms = true;
+    return options;
+}
+
+
+/// Shared by every shader, so all their variants fit one budget.
+inline ren::VariantCache& getVariantCache() {
+    static ren::VariantCache cache(16 * 1024 * 1024, getCompileOptions());
+    return cache;
+}
+
+
 class Shader {
 public:
     Shader(ren::ProgramPtr program)
-    : _program(program) {
+    : _program(program)
+    , _variants(program, getVariantCache(), getCompileQueue()) {
+        // Compile the starting constants now, so the first frame can
+        // be drawn.
+        std::ostringstream log;
+        if (!_variants.setFallback(log)) {
+            throw std::runtime_error("Error compiling shader:\n" + log.str());
+        }
     }
 
     ren::ProgramPtr getProgram() const {
@@ -78,18 +110,34 @@ public:
             unbind();
         }
 
-        const ren::Program::ValueList& constants = _program->getConstantValues();
-        const ren::Program::ValueList& uniforms  = _program->getUniformValues();
-        if (!_cache.count(constants)) {
-            _cache[constants].program = compile();
+        // New constant values compile in the background.  Until they
+        // finish, the last variant that compiled is drawn instead.
+        ren::CompileResultPtr cr = _variants.get(std::cerr);
+        ShaderCache::iterator entry = _cache.find(cr.get());
+        if (entry == _cache.end() || entry->second.result.lock() != cr) {
+            entry = addProgram(cr);
         }
-        _cache[constants].uniforms = uniforms;
+        entry->second.uniforms = _program->getUniformValues();
 
-        GLhandleARB programObject = _cache[constants].program;
+        GLhandleARB programObject = entry->second.program;
         glUseProgramObjectARB(programObject);
 
+        // Everything but the samplers goes up in one call.
+        const ren::UniformLayout& layout = _program->getUniformLayout();
+        GLint arrayLocation = glGetUniformLocationARB(
+            programObject,
+            ren::UniformLayout::ARRAY_NAME);
+        if (arrayLocation != -1) {
+            glUniform4fvARB(arrayLocation,
+                            layout.getSize() / 4,
+                            _program->getUniformBuffer());
+        }
+
         for (size_t i = 0; i < _program->getUniforms().size(); ++i) {
             const ren::Input& u = _program->getUniforms()[i];
+            if (layout.find(u.getName())) {
+                continue;
+            }
 
             GLint location = glGetUniformLocationARB(
                 programObject,
@@ -100,13 +148,7 @@ public:
             ren::ValuePtr uniformValue = _program->getUniformValue(
                 u.getName());
 
-            if (u.getType() == ren::VEC3) {
-                glUniform3fvARB(location, 1, uniformValue->asFloatVec());
-            } else if (u.getType() == ren::VEC2) {
-                glUniform2fvARB(location, 1, uniformValue->asFloatVec());
-            } else if (u.getType() == ren::FLOAT) {
-                glUniform1fARB(location, uniformValue->asFloat());
-            } else if (u.getType() == ren::SAMPLER2D) {
+            if (u.getType() == ren::SAMPLER2D) {
                 glUniform1iARB(location, uniformValue->asInt());
             } else {
                 assert(!"Unknown uniform type");
@@ -119,12 +161,42 @@ public:
     }
 
 private:
-    GLhandleARB compile() {
-        std::ostringstream log;
-        ren::CompileResult cr(ren::compile(_program, log));
-        if (!cr.success) {
-            throw std::runtime_error("Error compiling shader:\n" + log.str());
+    /**
+     * A compiled and linked program and its set of current uniforms.
+     */
+    struct CacheEntry {
+        CacheEntry()
+        : program(0) {
+        }
+
+        boost::weak_ptr<const ren::CompileResult> result;
+        GLhandleARB program;
+        ren::Program::ValueList uniforms;
+    };
+
+    /// Linked programs, by the cache result they were linked from.
+    typedef std::map<const ren::CompileResult*, CacheEntry> ShaderCache;
+
+    /// Links cr, first deleting the programs whose results the
+    /// variant cache has dropped.
+    ShaderCache::iterator addProgram(ren::CompileResultPtr cr) {
+        ShaderCache::iterator i = _cache.begin();
+        while (i != _cache.end()) {
+            if (i->second.result.expired()) {
+                glDeleteObjectARB(i->second.program);
+                _cache.erase(i++);
+            } else {
+                ++i;
+            }
         }
+
+        CacheEntry e;
+        e.result = cr;
+        e.program = link(*cr);
+        return _cache.insert(ShaderCache::value_type(cr.get(), e)).first;
+    }
+
+    static GLhandleARB link(const ren::CompileResult& cr) {
         std::cout << "Compile successful.\n"
                   << "Vertex Shader\n----\n"
                   << cr.vertexShader
@@ -163,45 +235,7 @@ private:
     }
 
     ren::ProgramPtr _program;
-
-    /**
-     * A compiled and linked program and its set of current uniforms.
-     */
-    struct CacheEntry {
-        CacheEntry()
-        : program(0) {
-        }
-
-        GLhandleARB program;
-        ren::Program::ValueList uniforms;
-    };
-
-    /**
-     * Compare the *values* of the constants, not the pointers.
-     */
-    struct ValueListComparator {
-        bool operator()(const ren::Program::ValueList& a,
-                        const ren::Program::ValueList& b) const {
-            // The Program shouldn't have any new constants added as
-            // this is running...  This would be better enforced in
-            // the type system somewhere.
-            assert(a.size() == b.size());
-
-            /*
-            if (a.size() < b.size()) { return true;  }
-            if (b.size() < a.size()) { return false; }
-            */
-            
-            for (size_t i = 0; i < a.size(); ++i) {
-                if (*a[i] < *b[i]) { return true;  }
-                if (*b[i] < *a[i]) { return false; }
-            }
-            return false;
-        }
-    };
-
-    typedef std::map<ren::Program::ValueList, CacheEntry,
-                     ValueListComparator> ShaderCache;
+    ren::VariantSelector _variants;
     ShaderCache _cache;
 };
 typedef boost::shared_ptr<Shader> ShaderPtr;
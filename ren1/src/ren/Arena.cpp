@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <new>
+#include "Arena.h"
+
+
+namespace ren {
+
+    static const size_t CHUNK_SIZE = 16 * 1024;
+
+    /// Larger blocks aren't reused before the arena goes away.
+    static const size_t MAX_RECYCLED_SIZE = 512;
+
+
+    /// Records where an ArenaObject came from.  The union keeps the
+    /// object after it aligned for any type.
+    union ArenaHeader {
+        Arena* arena;
+        long double align1;
+        void* align2;
+    };
+
+
+    static size_t roundUp(size_t size) {
+        const size_t a = sizeof(ArenaHeader);
+        return (size + a - 1) / a * a;
+    }
+
+
+    static size_t getSizeClass(size_t roundedSize) {
+        return roundedSize / sizeof(ArenaHeader);
+    }
+
+
+    REN_THREAD_LOCAL Arena* Arena::_current = 0;
+
+
+    Arena::Arena()
+    : _next(0)
+    , _end(0)
+    , _free(getSizeClass(MAX_RECYCLED_SIZE) + 1)
+    , _allocationCount(0)
+    , _bytesUsed(0)
+    , _bytesReserved(0) {
+    }
+
+
+    Arena::~Arena() {
+        for (size_t i = 0; i < _chunks.size(); ++i) {
+            ::operator delete(_chunks[i]);
+        }
+    }
+
+
+    void* Arena::allocate(size_t size) {
+        size = roundUp(size);
+
+        if (size <= MAX_RECYCLED_SIZE) {
+            void*& head = _free[getSizeClass(size)];
+            if (head) {
+                void* rv = head;
+                head = *static_cast<void**>(rv);
+                ++_allocationCount;
+                return rv;
+            }
+        }
+
+        if (size > size_t(_end - _next)) {
+            // Big objects get a chunk of their own, so they don't
+            // waste the rest of the current one.
+            size_t chunkSize = std::max(size, CHUNK_SIZE);
+            char* chunk = static_cast<char*>(::operator new(chunkSize));
+            _chunks.push_back(chunk);
+            _bytesReserved += chunkSize;
+
+            if (size >= CHUNK_SIZE) {
+                ++_allocationCount;
+                _bytesUsed += size;
+                return chunk;
+            }
+            _next = chunk;
+            _end = chunk + chunkSize;
+        }
+
+        void* rv = _next;
+        _next += size;
+        ++_allocationCount;
+        _bytesUsed += size;
+        return rv;
+    }
+
+
+    void Arena::release(void* p, size_t size) {
+        size = roundUp(size);
+        if (size <= MAX_RECYCLED_SIZE) {
+            void*& head = _free[getSizeClass(size)];
+            *static_cast<void**>(p) = head;
+            head = p;
+        }
+    }
+
+
+    void* ArenaObject::operator new(size_t size) {
+        size += sizeof(ArenaHeader);
+
+        ArenaHeader* header;
+        if (Arena* arena = Arena::getCurrent()) {
+            header = static_cast<ArenaHeader*>(arena->allocate(size));
+            header->arena = arena;
+        } else {
+            header = static_cast<ArenaHeader*>(::operator new(size));
+            header->arena = 0;
+        }
+        return header + 1;
+    }
+
+
+    void ArenaObject::operator delete(void* p, size_t size) {
+        if (!p) {
+            return;
+        }
+        ArenaHeader* header = static_cast<ArenaHeader*>(p) - 1;
+        if (header->arena) {
+            header->arena->release(header, size + sizeof(ArenaHeader));
+        } else {
+            ::operator delete(header);
+        }
+    }
+
+}
@@ -0,0 +1,97 @@
+#ifndef REN_ARENA_H
+#define REN_ARENA_H
+
+
+#include <cstddef>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include "Base.h"
+
+
+namespace ren {
+
+    /**
+     * A region that hands out memory by bumping a pointer and frees it
+     * all at once when destroyed.  Each compile owns one, so the
+     * thousands of small nodes it builds don't each go through malloc.
+     * Small blocks released early are reused for blocks of their size.
+     */
+    class Arena : public boost::noncopyable {
+    public:
+        Arena();
+        ~Arena();
+
+        void* allocate(size_t size);
+        void release(void* p, size_t size);
+
+        size_t getAllocationCount() const {
+            return _allocationCount;
+        }
+
+        /// Bytes handed out, including per-object headers.
+        size_t getBytesUsed() const {
+            return _bytesUsed;
+        }
+
+        /// Bytes taken from the heap.  This is the arena's peak, since
+        /// nothing is returned until it's destroyed.
+        size_t getBytesReserved() const {
+            return _bytesReserved;
+        }
+
+        /// The arena ArenaObjects are allocated from, or null.  Each
+        /// thread has its own, so compiles can run side by side.
+        static Arena* getCurrent() {
+            return _current;
+        }
+
+    private:
+        std::vector<char*> _chunks;
+        char* _next;
+        char* _end;
+
+        /// Released blocks, by size class.  Each links to the next.
+        std::vector<void*> _free;
+
+        size_t _allocationCount;
+        size_t _bytesUsed;
+        size_t _bytesReserved;
+
+        static REN_THREAD_LOCAL Arena* _current;
+        friend class ArenaScope;
+    };
+
+
+    /// Makes an arena current for as long as the scope lives.
+    class ArenaScope : public boost::noncopyable {
+    public:
+        ArenaScope(Arena& arena)
+        : _previous(Arena::_current) {
+            Arena::_current = &arena;
+        }
+
+        ~ArenaScope() {
+            Arena::_current = _previous;
+        }
+
+    private:
+        Arena* _previous;
+    };
+
+
+    /**
+     * Objects of derived classes are allocated from the current arena,
+     * or from the heap if there isn't one.  Deleting an arena object
+     * gives its memory back to the arena, so every arena object must be
+     * destroyed before its arena is.
+     */
+    class ArenaObject {
+    public:
+        static void* operator new(size_t size);
+        static void operator delete(void* p, size_t size);
+    };
+
+}
+
+
+#endif
@@ -14,12 +14,43 @@
 #define REN_DYNAMIC_CAST_PTR(name, type, object)        \
     boost::shared_ptr<type> name = boost::dynamic_pointer_cast<type>(object)
 
+// Like the casts above, for classes tagged with getKind() and KIND.
+// They compare tags instead of asking RTTI.  type is the class, not
+// the pointer type.
+#define REN_KIND_CAST(name, type, object)       \
+    type* name = ren::kindCast<type>(object)
+
+#define REN_KIND_CAST_PTR(name, type, object)                   \
+    boost::shared_ptr<type> name = ren::kindCastPtr<type>(object)
+
+// One instance of a variable per thread.  Only for plain old data.
+#ifdef _MSC_VER
+#define REN_THREAD_LOCAL __declspec(thread)
+#else
+#define REN_THREAD_LOCAL __thread
+#endif
+
 
 namespace ren {
 
     using std::string;
 
 
+    template<typename T, typename U>
+    T* kindCast(U* object) {
+        return (object && object->getKind() == T::KIND)
+            ? static_cast<T*>(object)
+            : 0;
+    }
+
+    template<typename T, typename U>
+    boost::shared_ptr<T> kindCastPtr(const boost::shared_ptr<U>& object) {
+        return (object && object->getKind() == T::KIND)
+            ? boost::static_pointer_cast<T>(object)
+            : boost::shared_ptr<T>();
+    }
+
+
     template<typename T>
     class NotNull {
     public:
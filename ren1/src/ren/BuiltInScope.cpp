@@ -1,135 +1,62 @@
+#include <map>
+#include <boost/thread/once.hpp>
 #include "BuiltInScope.h"
 
 
 namespace ren {
 
-    static bool isInteger(const string& name) {
-        for (size_t i = 0; i < name.size(); ++i) {
-            if (!isdigit(name[i])) {
-                return false;
-            }
-        }
-        return true;
-    }
+    enum LiteralType {
+        NOT_LITERAL,
+        INTEGER_LITERAL,
+        FLOAT_LITERAL,
+    };
 
 
-    static bool isFloat(const string& name) {
+    /// One pass over name: digits, with at most one period for floats.
+    static LiteralType classifyLiteral(const string& name) {
         bool has_period = false;
         for (size_t i = 0; i < name.size(); ++i) {
             if (name[i] == '.') {
                 if (has_period) {
-                    return false;
+                    return NOT_LITERAL;
                 }
                 has_period = true;
             } else if (!isdigit(name[i])) {
-                return false;
+                return NOT_LITERAL;
             }
         }
-        return has_period;
+        return has_period ? FLOAT_LITERAL : INTEGER_LITERAL;
     }
 
 
-#define RETURN_PTR(ptr) return ConcreteNodePtr(ptr)
+    enum BuiltInType {
+        VALUE,
+        NULLARY_FUNCTION,
+        FUNCTION,
+        INFIX,
+        PREFIX,
+        SWIZZLE,
+    };
 
+    struct BuiltIn {
+        string name;
+        Type type;
+        Frequency frequency;
+        BuiltInType nodeType;
+        Linearity linearity;
+    };
 
-    ConcreteNodePtr BuiltInScope::lookup(const string& name, Type argTypes) {
-        // Boolean constants.
-        if (name == "true" || name == "false") {
-            if (Type(argTypes) == NullType) {
-                bool value = (name == "true");
-                RETURN_PTR(
-                    new ValueNode(
-                        name,
-                        BOOL,
-                        CONSTANT,
-                        Value::create(BOOL, &value)));
-            } else {
-                throw CompileError("Can't call a boolean.");
-            }
-        }
+    typedef std::pair<string, Type> BuiltInKey;
+    typedef std::map<BuiltInKey, const BuiltIn*> BuiltInIndex;
 
-        // Integer constants.
-        if (isInteger(name)) {
-            if (Type(argTypes) == NullType) {
-                int value = atoi(name.c_str());
-                RETURN_PTR(
-                    new ValueNode(
-                        name,
-                        INT,
-                        CONSTANT,
-                        Value::create(INT, &value)));
-            } else {
-                throw CompileError("Can't call an integer.");
-            }
-        }
 
-        // Float constants.
-        if (isFloat(name)) {
-            if (Type(argTypes) == NullType) {
-                float value = atof(name.c_str());
-                RETURN_PTR(
-                    new ValueNode(
-                        name,
-                        FLOAT,
-                        CONSTANT,
-                        Value::create(FLOAT, &value)));
-            } else {
-                throw CompileError("Can't call a float.");
-            }
-        }
+    static const BuiltInIndex* builtInIndex;
+    static boost::once_flag builtInIndexOnce = BOOST_ONCE_INIT;
 
-        // If construct.
-        if (name == "if") {
-            TypeList tl(asTuple(argTypes));
-            if (tl.size() != 3) {
-                throw CompileError("if construct requires three arguments.");
-            }
-            if (tl[0] != BOOL) {
-                throw CompileError("if condition must have type bool.");
-            }
-            if (tl[1] != tl[2]) {
-                throw CompileError("if true-part and false-part must have same type.");
-            }
-            RETURN_PTR(new IfNode(argTypes >> tl[1]));
-        }
 
+    static void makeBuiltIns() {
         const Linearity PUNT = NONLINEAR;
 
-        // Vector concatenation.
-        if (name == "++") {
-            TypeList tl(asTuple(argTypes));
-            if (tl.size() == 2) {
-                Type el1 = getElementType(tl[0]);
-                Type el2 = getElementType(tl[1]);
-                if (el1 == el2 && el1 != NullType) {
-                    int length1 = getVectorLength(tl[0]);
-                    int length2 = getVectorLength(tl[1]);
-                    Type vec = getVectorType(el1, length1 + length2);
-                    RETURN_PTR(
-                        new FunctionNode(
-                            vec.getName(), el1 * el2 >> vec,
-                            FunctionNode::FUNCTION, PUNT));
-                }
-            }
-        }
-
-        enum BuiltInType {
-            VALUE,
-            NULLARY_FUNCTION,
-            FUNCTION,
-            INFIX,
-            PREFIX,
-            SWIZZLE,
-        };
-
-        struct BuiltIn {
-            string name;
-            Type type;
-            Frequency frequency;
-            BuiltInType nodeType;
-            Linearity linearity;
-        };
-
         static const BuiltIn builtIns[] = {
             { "*", MAT4 * VEC4 >> VEC4,    CONSTANT, INFIX, PARTIALLY_LINEAR },
             { "*", MAT3 * VEC3 >> VEC3,    CONSTANT, INFIX, PARTIALLY_LINEAR },
@@ -209,56 +136,164 @@ namespace ren {
 
 #define REN_ARRAY_SIZE(array) (sizeof(array) / sizeof(*(array)))
 
+        static BuiltInIndex index;
         for (size_t i = 0; i < REN_ARRAY_SIZE(builtIns); ++i) {
             const BuiltIn& b = builtIns[i];
-            if (name == b.name && argTypes == asFunction(b.type).in) {
-                switch (b.nodeType) {
-                    case VALUE:
-                        RETURN_PTR(
-                            new ValueNode(
-                                b.name, b.type, b.frequency, NullValue));
-                        break;
-                    case NULLARY_FUNCTION:
-                        RETURN_PTR(
-                            new ValueNode(
-                                b.name, b.type, b.frequency,
-                                NullValue, ValueNode::BUILTIN, true));
-                        break;
-                    case FUNCTION:
-                        assert(b.frequency == CONSTANT);
-                        RETURN_PTR(
-                            new FunctionNode(
-                                b.name, b.type,
-                                FunctionNode::FUNCTION, b.linearity));
-                        break;
-                    case PREFIX:
-                        assert(b.frequency == CONSTANT);
-                        RETURN_PTR(
-                            new FunctionNode(
-                                b.name, b.type,
-                                FunctionNode::PREFIX, b.linearity));
-                        break;
-                    case INFIX:
-                        assert(b.frequency == CONSTANT);
-                        RETURN_PTR(
-                            new FunctionNode(
-                                b.name, b.type,
-                                FunctionNode::INFIX, b.linearity));
-                        break;
-                    case SWIZZLE:
-                        assert(b.frequency == CONSTANT);
-                        RETURN_PTR(
-                            new FunctionNode(
-                                b.name, b.type,
-                                FunctionNode::SWIZZLE, b.linearity));
-                        break;
-                    default:
-                        assert(!"Unknown Built-In Node Type");
-                        break;
+            // insert() keeps the first row for a signature.
+            index.insert(BuiltInIndex::value_type(
+                             BuiltInKey(b.name, asFunction(b.type).in),
+                             &b));
+        }
+        builtInIndex = &index;
+    }
+
+
+    /// Built-ins by name and argument types.  Built on first use, after
+    /// the Type constants have been initialized, and only once however
+    /// many threads ask.
+    static const BuiltInIndex& getBuiltIns() {
+        boost::call_once(builtInIndexOnce, makeBuiltIns);
+        return *builtInIndex;
+    }
+
+
+#define RETURN_PTR(ptr) return ConcreteNodePtr(ptr)
+
+
+    ConcreteNodePtr BuiltInScope::lookup(const string& name, Type argTypes) {
+        // Boolean constants.
+        if (name == "true" || name == "false") {
+            if (Type(argTypes) == NullType) {
+                bool value = (name == "true");
+                RETURN_PTR(
+                    new ValueNode(
+                        name,
+                        BOOL,
+                        CONSTANT,
+                        Value::create(BOOL, &value)));
+            } else {
+                throw CompileError("Can't call a boolean.");
+            }
+        }
+
+        LiteralType literal = classifyLiteral(name);
+
+        // Integer constants.
+        if (literal == INTEGER_LITERAL) {
+            if (Type(argTypes) == NullType) {
+                int value = atoi(name.c_str());
+                RETURN_PTR(
+                    new ValueNode(
+                        name,
+                        INT,
+                        CONSTANT,
+                        Value::create(INT, &value)));
+            } else {
+                throw CompileError("Can't call an integer.");
+            }
+        }
+
+        // Float constants.
+        if (literal == FLOAT_LITERAL) {
+            if (Type(argTypes) == NullType) {
+                float value = atof(name.c_str());
+                RETURN_PTR(
+                    new ValueNode(
+                        name,
+                        FLOAT,
+                        CONSTANT,
+                        Value::create(FLOAT, &value)));
+            } else {
+                throw CompileError("Can't call a float.");
+            }
+        }
+
+        // If construct.
+        if (name == "if") {
+            TypeList tl(asTuple(argTypes));
+            if (tl.size() != 3) {
+                throw CompileError("if construct requires three arguments.");
+            }
+            if (tl[0] != BOOL) {
+                throw CompileError("if condition must have type bool.");
+            }
+            if (tl[1] != tl[2]) {
+                throw CompileError("if true-part and false-part must have same type.");
+            }
+            RETURN_PTR(new IfNode(argTypes >> tl[1]));
+        }
+
+        const Linearity PUNT = NONLINEAR;
+
+        // Vector concatenation.
+        if (name == "++") {
+            TypeList tl(asTuple(argTypes));
+            if (tl.size() == 2) {
+                Type el1 = getElementType(tl[0]);
+                Type el2 = getElementType(tl[1]);
+                if (el1 == el2 && el1 != NullType) {
+                    int length1 = getVectorLength(tl[0]);
+                    int length2 = getVectorLength(tl[1]);
+                    Type vec = getVectorType(el1, length1 + length2);
+                    RETURN_PTR(
+                        new FunctionNode(
+                            vec.getName(), el1 * el2 >> vec,
+                            FunctionNode::FUNCTION, PUNT));
                 }
             }
         }
 
+        const BuiltInIndex& builtIns = getBuiltIns();
+        BuiltInIndex::const_iterator i = builtIns.find(
+            BuiltInKey(name, argTypes));
+        if (i != builtIns.end()) {
+            const BuiltIn& b = *i->second;
+            switch (b.nodeType) {
+                case VALUE:
+                    RETURN_PTR(
+                        new ValueNode(
+                            b.name, b.type, b.frequency, NullValue));
+                    break;
+                case NULLARY_FUNCTION:
+                    RETURN_PTR(
+                        new ValueNode(
+                            b.name, b.type, b.frequency,
+                            NullValue, ValueNode::BUILTIN, true));
+                    break;
+                case FUNCTION:
+                    assert(b.frequency == CONSTANT);
+                    RETURN_PTR(
+                        new FunctionNode(
+                            b.name, b.type,
+                            FunctionNode::FUNCTION, b.linearity));
+                    break;
+                case PREFIX:
+                    assert(b.frequency == CONSTANT);
+                    RETURN_PTR(
+                        new FunctionNode(
+                            b.name, b.type,
+                            FunctionNode::PREFIX, b.linearity));
+                    break;
+                case INFIX:
+                    assert(b.frequency == CONSTANT);
+                    RETURN_PTR(
+                        new FunctionNode(
+                            b.name, b.type,
+                            FunctionNode::INFIX, b.linearity));
+                    break;
+                case SWIZZLE:
+                    assert(b.frequency == CONSTANT);
+                    RETURN_PTR(
+                        new FunctionNode(
+                            b.name, b.type,
+                            FunctionNode::SWIZZLE, b.linearity));
+                    break;
+                default:
+                    assert(!"Unknown Built-In Node Type");
+                    break;
+            }
+        }
+
         return ConcreteNodePtr();
     }
 
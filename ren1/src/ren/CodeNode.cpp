@@ -1,6 +1,97 @@
+#include <algorithm>
 #include "CodeNode.h"
 
 
 namespace ren {
 
+    CodeNode::CodeNode(Kind kind, const CodeNodeList& children)
+    : _kind(kind)
+    , _children(children) {
+        for (size_t i = 0; i < _children.size(); ++i) {
+            assert(_children[i]);
+            _children[i]->addUser(this);
+        }
+    }
+
+
+    CodeNode::~CodeNode() {
+        for (size_t i = 0; i < _children.size(); ++i) {
+            _children[i]->removeUser(this);
+        }
+    }
+
+
+    string CodeNode::asExpression() const {
+        string rv;
+        StringSink sink(rv);
+        {
+            GLSLWriter w(sink);
+            writeExpression(w);
+        }
+        return rv;
+    }
+
+
+    void CodeNode::setChild(size_t i, CodeNodePtr with) {
+        assert(i < _children.size());
+        assert(with);
+
+        // Keep the old child alive until we're done with it.
+        CodeNodePtr old = _children[i];
+        old->removeUser(this);
+        _children[i] = with;
+        with->addUser(this);
+
+        childChanged();
+    }
+
+
+    void CodeNode::replaceUse(CodeNode* node, CodeNodePtr with) {
+        for (size_t i = 0; i < _children.size(); ++i) {
+            if (_children[i].get() == node) {
+                setChild(i, with);
+            }
+        }
+    }
+
+
+    void CodeNode::childChanged() {
+        // Stop as soon as nothing changes, so a rewrite that preserves
+        // frequency and linearity touches only the rewritten node.
+        if (update()) {
+            for (size_t i = 0; i < _users.size(); ++i) {
+                _users[i]->childChanged();
+            }
+        }
+    }
+
+
+    void CodeNode::addUser(CodeNodeUser* user) {
+        _users.push_back(user);
+    }
+
+
+    void CodeNode::removeUser(CodeNodeUser* user) {
+        // Search from the back: that's where replaceUses works.
+        CodeNodeUserList::reverse_iterator i = std::find(
+            _users.rbegin(), _users.rend(), user);
+        assert(i != _users.rend());
+        _users.erase(--i.base());
+    }
+
+
+    void replaceUses(CodeNodePtr node, CodeNodePtr with) {
+        assert(node);
+        assert(with);
+        if (node == with) {
+            return;
+        }
+
+        // replaceUse removes entries from the list as it goes, and
+        // handles every reference a user has at once.
+        while (!node->getUsers().empty()) {
+            node->getUsers().back()->replaceUse(node.get(), with);
+        }
+    }
+
 }
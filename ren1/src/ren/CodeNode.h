@@ -3,6 +3,7 @@
 
 
 #include "ConcreteNode.h"
+#include "GLSLWriter.h"
 #include "Types.h"
 
 
@@ -13,39 +14,110 @@ namespace ren {
     typedef std::vector<CodeNodePtr> CodeNodeList;
 
 
-    class CodeNode {
+    /**
+     * Anything that refers to CodeNodes: another CodeNode, or a
+     * statement in a generated shader.  Each CodeNode keeps a list of
+     * its users, so a node can be replaced without searching for it.
+     */
+    class CodeNodeUser {
     public:
-        CodeNode() {
-        }
+        /// Make every reference to node refer to with instead.
+        virtual void replaceUse(CodeNode* node, CodeNodePtr with) = 0;
 
-        virtual ~CodeNode() { }
+        /// Called when a node we use may have changed its attributes.
+        virtual void childChanged() { }
+
+    protected:
+        ~CodeNodeUser() { }
+    };
+    typedef std::vector<CodeNodeUser*> CodeNodeUserList;
+
+
+    class CodeNode : public CodeNodeUser, public ArenaObject {
+    public:
+        /// Which subclass this is, for switches and REN_KIND_CAST.
+        enum Kind {
+            IF_CODE_NODE,
+            CALL_CODE_NODE,
+            NAME_CODE_NODE,
+        };
+
+        CodeNode(Kind kind, const CodeNodeList& children = CodeNodeList());
+        virtual ~CodeNode();
+
+        Kind getKind() const {
+            return _kind;
+        }
 
         virtual Type getType() const = 0;
         virtual Frequency getFrequency() const = 0;
-        virtual string asExpression() const = 0;
+        virtual void writeExpression(GLSLWriter& w) const = 0;
+
+        /// The expression as a string.  Emitters should write it instead.
+        string asExpression() const;
 
         // Can this node be lifted across an interpolation boundary?
         // (Fragment -> Vertex pipeline)
         virtual bool canInterpolate() const = 0;
 
-        /// Don't resize the list returned by this method.
-        virtual CodeNodeList& getChildren() = 0;
+        const CodeNodeList& getChildren() const {
+            return _children;
+        }
+
+        void setChild(size_t i, CodeNodePtr with);
+
+        void replaceUse(CodeNode* node, CodeNodePtr with);
+        void childChanged();
+
+        /// One entry per reference, so x + x lists its parent twice.
+        const CodeNodeUserList& getUsers() const {
+            return _users;
+        }
+
+        void addUser(CodeNodeUser* user);
+        void removeUser(CodeNodeUser* user);
+
+    protected:
+        /**
+         * Recompute the attributes cached from our children, such as
+         * frequency.  Returns true if any of them changed.
+         */
+        virtual bool update() {
+            return false;
+        }
+
+    private:
+        // Users point back at us, so we can't be copied.
+        CodeNode(const CodeNode&);
+        CodeNode& operator=(const CodeNode&);
+
+        Kind _kind;
+        CodeNodeList _children;
+        CodeNodeUserList _users;
     };
 
 
+    /**
+     * Replace every use of node with with.  Only node's users are
+     * visited, so this is proportional to the number of uses.
+     */
+    extern void replaceUses(CodeNodePtr node, CodeNodePtr with);
+
+
     /// Represents a conditional.
     class IfCodeNode : public CodeNode {
     public:
+        static const Kind KIND = IF_CODE_NODE;
+
         IfCodeNode(
             Type type,
             CodeNodePtr condition,
             CodeNodePtr truePart,
             CodeNodePtr falsePart)
-        : _type(type)
-        , _children(3) {
-            _children[0] = condition;
-            _children[1] = truePart;
-            _children[2] = falsePart;
+        : CodeNode(KIND, makeChildren(condition, truePart, falsePart))
+        , _type(type)
+        , _frequency(CONSTANT) {
+            update();
         }
 
         Type getType() const {
@@ -53,31 +125,51 @@ namespace ren {
         }
 
         Frequency getFrequency() const {
-            assert(_children.size() == 3);
-            // eh? what should this really be?
-            return std::max(_children[1]->getFrequency(),
-                            _children[2]->getFrequency());
+            return _frequency;
         }
 
-        string asExpression() const {
+        void writeExpression(GLSLWriter& w) const {
             //assert(!"IfCodeNode can't directly be turned into an expression.");
-            return
-                "(" + _children[0]->asExpression() +
-                " ? " + _children[1]->asExpression() +
-                " : " + _children[2]->asExpression();
+            const CodeNodeList& children = getChildren();
+            w << "(";
+            children[0]->writeExpression(w);
+            w << " ? ";
+            children[1]->writeExpression(w);
+            w << " : ";
+            children[2]->writeExpression(w);
         }
 
         bool canInterpolate() const {
             return false;
         }
 
-        CodeNodeList& getChildren() {
-            return _children;
+    protected:
+        bool update() {
+            const CodeNodeList& children = getChildren();
+            assert(children.size() == 3);
+            // eh? what should this really be?
+            Frequency frequency = std::max(children[1]->getFrequency(),
+                                           children[2]->getFrequency());
+            bool changed = (frequency != _frequency);
+            _frequency = frequency;
+            return changed;
         }
 
     private:
+        static CodeNodeList makeChildren(
+            CodeNodePtr condition,
+            CodeNodePtr truePart,
+            CodeNodePtr falsePart
+        ) {
+            CodeNodeList children(3);
+            children[0] = condition;
+            children[1] = truePart;
+            children[2] = falsePart;
+            return children;
+        }
+
         Type _type;
-        CodeNodeList _children;
+        Frequency _frequency;
     };
     REN_SHARED_PTR(IfCodeNode);
 
@@ -87,17 +179,22 @@ namespace ren {
     public:
         typedef FunctionNode::CallType CallType;
 
+        static const Kind KIND = CALL_CODE_NODE;
+
         CallCodeNode(
             Type type,
             CallType callType,
             const string& op,
             const CodeNodeList& arguments,
             Linearity linearity)
-        : _type(type)
+        : CodeNode(KIND, arguments)
+        , _type(type)
         , _callType(callType)
         , _op(op)
-        , _arguments(arguments)
-        , _linearity(linearity) {
+        , _linearity(linearity)
+        , _frequency(CONSTANT)
+        , _canInterpolate(false) {
+            update();
         }
 
         Type getType() const {
@@ -105,58 +202,100 @@ namespace ren {
         }
 
         Frequency getFrequency() const {
-            assert(!_arguments.empty());
-            Frequency rv = _arguments[0]->getFrequency();
-            for (size_t i = 1; i < _arguments.size(); ++i) {
-                rv = std::max(rv, _arguments[i]->getFrequency());
-            }
-            return rv;            
+            return _frequency;
         }
 
-        string asExpression() const {
+        void writeExpression(GLSLWriter& w) const {
+            const CodeNodeList& arguments = getChildren();
             switch (_callType) {
                 case FunctionNode::SWIZZLE: {
-                    assert(_arguments.size() == 1);
-                    string arg = _arguments[0]->asExpression();
-                    return  arg + "." + _op;
+                    assert(arguments.size() == 1);
+                    arguments[0]->writeExpression(w);
+                    w << '.' << _op;
+                    break;
                 }
 
                 case FunctionNode::INFIX: {
-                    assert(_arguments.size() == 2);
-                    string lhs = _arguments[0]->asExpression();
-                    string rhs = _arguments[1]->asExpression();
-                    return "(" + lhs + " " + _op + " " + rhs + ")";
+                    assert(arguments.size() == 2);
+                    w << '(';
+                    arguments[0]->writeExpression(w);
+                    w << ' ' << _op << ' ';
+                    arguments[1]->writeExpression(w);
+                    w << ')';
+                    break;
                 }
 
                 case FunctionNode::PREFIX: {
-                    assert(_arguments.size() == 1);
-                    string e = _arguments[0]->asExpression();
-                    return "(" + _op + e + ")";
+                    assert(arguments.size() == 1);
+                    w << '(' << _op;
+                    arguments[0]->writeExpression(w);
+                    w << ')';
+                    break;
                 }
 
                 case FunctionNode::FUNCTION: {
-                    std::string rv = _op + "(";
-                    for (size_t i = 0; i < _arguments.size(); ++i) {
+                    w << _op << '(';
+                    for (size_t i = 0; i < arguments.size(); ++i) {
                         if (i != 0) {
-                            rv += ", ";
+                            w << ", ";
                         }
-                        rv += _arguments[i]->asExpression();
+                        arguments[i]->writeExpression(w);
                     }
-                    return rv + ")";
+                    w << ')';
+                    break;
                 }
                     
                 default:
                     assert(!"Unknown Call Type");
-                    return "<unknown>";
+                    w << "<unknown>";
             }
         }
 
         bool canInterpolate() const {
+            return _canInterpolate;
+        }
+
+        CallType getCallType() const {
+            return _callType;
+        }
+
+        string getOperator() const {
+            return _op;
+        }
+
+        Linearity getLinearity() const {
+            return _linearity;
+        }
+
+    protected:
+        bool update() {
+            Frequency frequency = computeFrequency();
+            bool interpolate = computeCanInterpolate();
+            bool changed = (frequency   != _frequency ||
+                            interpolate != _canInterpolate);
+            _frequency      = frequency;
+            _canInterpolate = interpolate;
+            return changed;
+        }
+
+    private:
+        Frequency computeFrequency() const {
+            const CodeNodeList& arguments = getChildren();
+            assert(!arguments.empty());
+            Frequency rv = arguments[0]->getFrequency();
+            for (size_t i = 1; i < arguments.size(); ++i) {
+                rv = std::max(rv, arguments[i]->getFrequency());
+            }
+            return rv;
+        }
+
+        bool computeCanInterpolate() const {
+            const CodeNodeList& arguments = getChildren();
             switch (_linearity) {
                 case LINEAR: {
                     bool rv = true;
-                    for (size_t i = 0; i < _arguments.size(); ++i) {
-                        rv = rv && _arguments[i]->canInterpolate();
+                    for (size_t i = 0; i < arguments.size(); ++i) {
+                        rv = rv && arguments[i]->canInterpolate();
                     }
                     return rv;
                 }
@@ -164,9 +303,9 @@ namespace ren {
                 case PARTIALLY_LINEAR: {
                     bool rv = true;
                     unsigned vertexFrequencyCount = 0;
-                    for (size_t i = 0; i < _arguments.size(); ++i) {
-                        rv = rv && _arguments[i]->canInterpolate();
-                        if (_arguments[i]->getFrequency() == VERTEX) {
+                    for (size_t i = 0; i < arguments.size(); ++i) {
+                        rv = rv && arguments[i]->canInterpolate();
+                        if (arguments[i]->getFrequency() == VERTEX) {
                             ++vertexFrequencyCount;
                         }
                     }
@@ -185,16 +324,13 @@ namespace ren {
             }
         }
 
-        CodeNodeList& getChildren() {
-            return _arguments;
-        }
-
-    private:
         Type _type;
         CallType _callType;
         string _op;
-        CodeNodeList _arguments;
         Linearity _linearity;
+
+        Frequency _frequency;
+        bool _canInterpolate;
     };
     REN_SHARED_PTR(CallCodeNode);
 
@@ -207,13 +343,16 @@ namespace ren {
     public:
         typedef ValueNode::InputType InputType;
 
+        static const Kind KIND = NAME_CODE_NODE;
+
         NameCodeNode(
             const string& name,
             Type type,
             Frequency frequency,
             ValuePtr value,
             InputType inputType)
-        : _name(name)
+        : CodeNode(KIND)
+        , _name(name)
         , _type(type)
         , _frequency(frequency)
         , _value(value)
@@ -234,18 +373,14 @@ namespace ren {
             return _value;
         }
 
-        string asExpression() const {
-            return _name;
+        void writeExpression(GLSLWriter& w) const {
+            w << _name;
         }
 
         bool canInterpolate() const {
             return _frequency <= VERTEX;
         }
 
-        CodeNodeList& getChildren() {
-            return _children;
-        }
-
         string getName() const {
             return _name;
         }
@@ -260,9 +395,6 @@ namespace ren {
         Frequency _frequency;
         ValuePtr _value;
         InputType _inputType;
-
-        // We need to return something...  leave it empty.
-        CodeNodeList _children;
     };
     REN_SHARED_PTR(NameCodeNode);
 
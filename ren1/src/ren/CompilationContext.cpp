@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <iterator>
 #include <sstream>
 #include "CompilationContext.h"
 #include "Errors.h"
@@ -6,8 +8,11 @@
 
 namespace ren {
 
-    CompilationContext::CompilationContext(ProgramPtr program)
-    : _scope(ProgramScope::create(program)) {
+    CompilationContext::CompilationContext(
+        ProgramPtr program,
+        const ConstantMap& constants
+    )
+    : _scope(ProgramScope::create(program, constants)) {
     }
 
     ConcreteNodePtr CompilationContext::instantiate(
@@ -28,128 +33,393 @@ namespace ren {
     }
 
 
-    typedef std::map<ConcreteNodePtr, ConcreteNodePtr> ReplacementMap;
+    bool CompilationContext::CodeNodeKey::operator<(
+        const CodeNodeKey& rhs
+    ) const {
+        if (kind      != rhs.kind)      return kind      < rhs.kind;
+        if (tag       != rhs.tag)       return tag       < rhs.tag;
+        if (frequency != rhs.frequency) return frequency < rhs.frequency;
+        if (name      != rhs.name)      return name      < rhs.name;
+        if (children  != rhs.children)  return children  < rhs.children;
+        if (type      != rhs.type)      return type      < rhs.type;
+        return false;
+    }
+
+
+    CodeNodePtr CompilationContext::findValue(const CodeNodeKey& key) {
+        ValueNumberTable::iterator i = _valueNumbers.find(key);
+        if (i != _valueNumbers.end()) {
+            return i->second;
+        }
+        return CodeNodePtr();
+    }
+
+
+    CodeNodePtr CompilationContext::makeName(ValueNodePtr v) {
+        CodeNodeKey key(CodeNodeKey::NAME, v->evaluate(), v->getType());
+        key.tag       = v->getInputType();
+        key.frequency = v->getFrequency();
+
+        if (CodeNodePtr existing = findValue(key)) {
+            return existing;
+        }
+        return _valueNumbers[key] = CodeNodePtr(
+            new NameCodeNode(
+                v->evaluate(),
+                v->getType(),
+                v->getFrequency(),
+                v->getValue(),
+                v->getInputType()));
+    }
+
+
+    CodeNodePtr CompilationContext::makeCall(
+        Type type,
+        FunctionNodePtr f,
+        const CodeNodeList& arguments
+    ) {
+        CodeNodeKey key(CodeNodeKey::CALL, f->getName(), type);
+        key.tag      = f->getCallType();
+        key.children = arguments;
+
+        if (CodeNodePtr existing = findValue(key)) {
+            return existing;
+        }
+        return _valueNumbers[key] = CodeNodePtr(
+            new CallCodeNode(
+                type,
+                f->getCallType(),
+                f->getName(),
+                arguments,
+                f->getLinearity()));
+    }
+
+
+    CodeNodePtr CompilationContext::makeIf(
+        Type type,
+        CodeNodePtr condition,
+        CodeNodePtr truePart,
+        CodeNodePtr falsePart
+    ) {
+        CodeNodeKey key(CodeNodeKey::IF, "if", type);
+        key.children.push_back(condition);
+        key.children.push_back(truePart);
+        key.children.push_back(falsePart);
+
+        if (CodeNodePtr existing = findValue(key)) {
+            return existing;
+        }
+        return _valueNumbers[key] = CodeNodePtr(
+            new IfCodeNode(
+                type,
+                condition,
+                truePart,
+                falsePart));
+    }
+
+
+    bool CompilationContext::ConcreteNodeKey::operator<(
+        const ConcreteNodeKey& rhs
+    ) const {
+        if (kind      != rhs.kind)      return kind      < rhs.kind;
+        if (tag       != rhs.tag)       return tag       < rhs.tag;
+        if (frequency != rhs.frequency) return frequency < rhs.frequency;
+        if (name      != rhs.name)      return name      < rhs.name;
+        if (children  != rhs.children)  return children  < rhs.children;
+        if (type      != rhs.type)      return type      < rhs.type;
+        return false;
+    }
+
+
+    ConcreteNodePtr CompilationContext::canonicalize(ConcreteNodePtr node) {
+        CanonicalMap::iterator i = _canonicalNodes.find(node);
+        if (i != _canonicalNodes.end()) {
+            return i->second;
+        }
+
+        ConcreteNodeKey key(ConcreteNodeKey::APPLICATION, "", NullType);
+        switch (node->getKind()) {
+            case ConcreteNode::VALUE_NODE: {
+                ValueNode* v = static_cast<ValueNode*>(node.get());
+                key = ConcreteNodeKey(
+                    ConcreteNodeKey::VALUE, v->evaluate(), v->getType());
+                key.tag       = v->getInputType();
+                key.frequency = v->getFrequency();
+                break;
+            }
+
+            case ConcreteNode::FUNCTION_NODE: {
+                FunctionNode* f = static_cast<FunctionNode*>(node.get());
+                key = ConcreteNodeKey(
+                    ConcreteNodeKey::FUNCTION, f->getName(), f->getType());
+                key.tag = f->getCallType();
+                break;
+            }
+
+            case ConcreteNode::APPLICATION_NODE: {
+                ApplicationNode* a = static_cast<ApplicationNode*>(node.get());
+                key.children.push_back(canonicalize(a->getFunction()));
+                const ConcreteNodeList& arguments = a->getArguments();
+                for (size_t i = 0; i < arguments.size(); ++i) {
+                    key.children.push_back(canonicalize(arguments[i]));
+                }
+                break;
+            }
+
+            default:
+                // Abstractions, arguments and if are already unique.
+                return _canonicalNodes[node] = node;
+        }
+
+        ConcreteNodePtr& canonical = _canonicalKeys[key];
+        if (!canonical) {
+            canonical = node;
+        }
+        return _canonicalNodes[node] = canonical;
+    }
 
 
-    ConcreteNodePtr copyAndReplace(
+    ConcreteNodePtr CompilationContext::makeApplication(
+        ConcreteNodePtr function,
+        const ConcreteNodeList& arguments
+    ) {
+        ApplicationKey key(function, arguments);
+        ApplicationTable::iterator i = _applications.find(key);
+        if (i != _applications.end()) {
+            return i->second;
+        }
+        return _applications[key] = ConcreteNodePtr(
+            new ApplicationNode(function, arguments));
+    }
+
+
+    const CompilationContext::ArgumentList&
+    CompilationContext::getFreeArguments(const ConcreteNodePtr& node) {
+        FreeArgumentMap::iterator i = _freeArguments.find(node);
+        if (i != _freeArguments.end()) {
+            return i->second;
+        }
+
+        ArgumentList rv;
+        switch (node->getKind()) {
+            case ConcreteNode::ARGUMENT_NODE:
+                rv.push_back(node.get());
+                break;
+
+            case ConcreteNode::APPLICATION_NODE: {
+                ApplicationNode* p = static_cast<ApplicationNode*>(node.get());
+                rv = getFreeArguments(p->getFunction());
+                const ConcreteNodeList& arguments = p->getArguments();
+                for (size_t i = 0; i < arguments.size(); ++i) {
+                    const ArgumentList& a = getFreeArguments(arguments[i]);
+                    ArgumentList merged;
+                    std::set_union(rv.begin(), rv.end(), a.begin(), a.end(),
+                                   std::back_inserter(merged));
+                    rv.swap(merged);
+                }
+                break;
+            }
+
+            case ConcreteNode::ABSTRACTION_NODE: {
+                AbstractionNode* p = static_cast<AbstractionNode*>(node.get());
+                ArgumentList bound;
+                const ConcreteNodeList& replacements = p->getReplacements();
+                for (size_t i = 0; i < replacements.size(); ++i) {
+                    bound.push_back(replacements[i].get());
+                }
+                std::sort(bound.begin(), bound.end());
+
+                const ArgumentList& inside = getFreeArguments(p->getInside());
+                std::set_difference(inside.begin(), inside.end(),
+                                    bound.begin(), bound.end(),
+                                    std::back_inserter(rv));
+                break;
+            }
+
+            default:
+                break;
+        }
+        return _freeArguments[node] = rv;
+    }
+
+
+    /**
+     * rm starts out mapping arguments to their values, and collects
+     * the copy of every node visited, so each node is copied once.
+     * Nodes that don't refer to any argument aren't copied at all, or
+     * even walked: a helper's body is closed, so substituting into a
+     * function that calls it never copies it.
+     */
+    ConcreteNodePtr CompilationContext::copyAndReplace(
         ConcreteNodePtr node,
-        const ReplacementMap& rm
+        ReplacementMap& rm
     ) {
         ReplacementMap::const_iterator fi = rm.find(node);
         if (fi != rm.end()) {
             return fi->second;
         }
+        if (getFreeArguments(node).empty()) {
+            return node;
+        }
 
-        if (REN_DYNAMIC_CAST(p, ApplicationNode*, node.get())) {
+        ConcreteNodePtr rv = node;
+        switch (node->getKind()) {
+            case ConcreteNode::APPLICATION_NODE: {
+                ApplicationNode* p = static_cast<ApplicationNode*>(node.get());
 
-            ConcreteNodePtr function = copyAndReplace(p->getFunction(), rm);
-            ConcreteNodeList arguments = p->getArguments();
-            for (size_t i = 0; i < arguments.size(); ++i) {
-                arguments[i] = copyAndReplace(arguments[i], rm);
+                ConcreteNodePtr function = copyAndReplace(p->getFunction(), rm);
+                bool changed = (function != p->getFunction());
+
+                ConcreteNodeList arguments = p->getArguments();
+                for (size_t i = 0; i < arguments.size(); ++i) {
+                    ConcreteNodePtr a = copyAndReplace(arguments[i], rm);
+                    changed = changed || (a != arguments[i]);
+                    arguments[i] = a;
+                }
+
+                if (changed) {
+                    rv = makeApplication(function, arguments);
+                }
+                break;
             }
 
-            return ConcreteNodePtr(new ApplicationNode(function, arguments));
-                    
-        } else if (REN_DYNAMIC_CAST(p, AbstractionNode*, node.get())) {
+            case ConcreteNode::ABSTRACTION_NODE: {
+                AbstractionNode* p = static_cast<AbstractionNode*>(node.get());
 
-            return ConcreteNodePtr(
-                new AbstractionNode(
-                    p->getReplacements(),
-                    copyAndReplace(p->getInside(), rm)));
+                ConcreteNodePtr inside = copyAndReplace(p->getInside(), rm);
+                if (inside != p->getInside()) {
+                    rv.reset(new AbstractionNode(p->getReplacements(), inside));
+                }
+                break;
+            }
 
-        } else if (REN_DYNAMIC_CAST(p, ArgumentNode*, node.get())) {
-            (void)p;
-            return node;
-        } else if (REN_DYNAMIC_CAST(p, FunctionNode*, node.get())) {
-            (void)p;
-            return node;
-        } else if (REN_DYNAMIC_CAST(p, ValueNode*, node.get())) {
-            (void)p;
-            return node;
-        } else {
-            assert(!"ICE: Unknown Concrete Node Type");
-            return node;
+            case ConcreteNode::ARGUMENT_NODE:
+            case ConcreteNode::FUNCTION_NODE:
+            case ConcreteNode::IF_NODE:
+            case ConcreteNode::VALUE_NODE:
+                break;
+
+            default:
+                assert(!"ICE: Unknown Concrete Node Type");
         }
+        return rm[node] = rv;
+    }
+
+
+    ConcreteNodePtr CompilationContext::substitute(
+        AbstractionNodePtr ab,
+        const ConcreteNodeList& actuals
+    ) {
+        // Equal arguments written in different places are different
+        // nodes; use the same one for all of them.
+        ConcreteNodeList arguments(actuals);
+        for (size_t i = 0; i < arguments.size(); ++i) {
+            arguments[i] = canonicalize(arguments[i]);
+        }
+
+        ApplicationKey key(ab, arguments);
+        ApplicationTable::iterator i = _substitutions.find(key);
+        if (i != _substitutions.end()) {
+            return i->second;
+        }
+
+        const ConcreteNodeList& replacements = ab->getReplacements();
+        assert(arguments.size() == replacements.size());
+
+        ReplacementMap rm;
+        for (size_t i = 0; i < arguments.size(); ++i) {
+            rm[replacements[i]] = arguments[i];
+        }
+
+        return _substitutions[key] = copyAndReplace(ab->getInside(), rm);
     }
 
 
     CodeNodePtr CompilationContext::evaluate(ConcreteNodePtr c) {
-        if (_evaluationCache[c]) {
-            return _evaluationCache[c];
+        EvaluationCache::iterator i = _evaluationCache.find(c);
+        if (i != _evaluationCache.end()) {
+            return i->second;
         }
 
-        if (REN_DYNAMIC_CAST_PTR(v, ValueNode, c)) {
-            return cache(c, CodeNodePtr(new NameCodeNode(
-                                            v->evaluate(),
-                                            v->getType(),
-                                            v->getFrequency(),
-                                            v->getValue(),
-                                            v->getInputType())));
-        } else if (REN_DYNAMIC_CAST_PTR(a, ApplicationNode, c)) {
+        switch (c->getKind()) {
+            case ConcreteNode::VALUE_NODE: {
+                return cache(c, makeName(
+                                 boost::static_pointer_cast<ValueNode>(c)));
+            }
 
-            ConcreteNodePtr function = a->getFunction();
-            const ConcreteNodeList& arguments = a->getArguments();
+            case ConcreteNode::APPLICATION_NODE:
+                return cache(c, evaluateApplication(
+                                 static_cast<ApplicationNode*>(c.get())));
 
-            if (REN_DYNAMIC_CAST_PTR(f, FunctionNode, function)) {
+            case ConcreteNode::ARGUMENT_NODE:
+                assert(!"Can't directly evaluate an ArgumentNode");
+                return CodeNodePtr();
 
-                CodeNodeList args;
-                for (size_t i = 0; i < arguments.size(); ++i) {
-                    args.push_back(evaluate(arguments[i]));
-                }
-                return cache(c, CodeNodePtr(new CallCodeNode(
-                                                c->getType(),
-                                                f->getCallType(),
-                                                f->getName(),
-                                                args,
-                                                f->getLinearity())));
+            case ConcreteNode::FUNCTION_NODE:
+                assert(!"Can't directly evaluate a FunctionNode");
+                return CodeNodePtr();
 
-            } else if (REN_DYNAMIC_CAST_PTR(ab, AbstractionNode, function)) {
+            default:
+                assert(!"Error Unknown ConcreteNode!");
+                return CodeNodePtr();
+        }
+    }
 
-                ConcreteNodePtr inside = ab->getInside();
-                const ConcreteNodeList& replacements = ab->getReplacements();
 
-                assert(arguments.size() == replacements.size());
+    CodeNodePtr CompilationContext::evaluateApplication(ApplicationNode* a) {
+        ConcreteNodePtr function = a->getFunction();
+        const ConcreteNodeList& arguments = a->getArguments();
 
-                ReplacementMap rm;
+        switch (function->getKind()) {
+            case ConcreteNode::FUNCTION_NODE: {
+                CodeNodeList args;
                 for (size_t i = 0; i < arguments.size(); ++i) {
-                    rm[replacements[i]] = arguments[i];
+                    args.push_back(evaluate(arguments[i]));
                 }
+                return makeCall(
+                    a->getType(),
+                    boost::static_pointer_cast<FunctionNode>(function),
+                    args);
+            }
 
-                // clone inside, replacing arguments
-                return cache(c, evaluate(copyAndReplace(inside, rm)));
-
-            } else if (REN_DYNAMIC_CAST_PTR(in, IfNode, function)) {
+            case ConcreteNode::ABSTRACTION_NODE: {
+                return evaluate(substitute(
+                    boost::static_pointer_cast<AbstractionNode>(function),
+                    arguments));
+            }
 
+            case ConcreteNode::IF_NODE: {
                 if (arguments.size() != 3) {
                     throw CompileError("if construct requires exactly 3 arguments.");
                 }
                 CodeNodePtr condition(evaluate(arguments[0]));
+
+                // Constant conditions are specialized here, so the
+                // untaken arm is never evaluated.
+                if (REN_KIND_CAST(n, NameCodeNode, condition.get())) {
+                    if (n->getFrequency() == CONSTANT && n->getValue()) {
+                        assert(n->getType() == BOOL);
+                        if (n->getValue()->asBool()) {
+                            return evaluate(arguments[1]);
+                        } else {
+                            return evaluate(arguments[2]);
+                        }
+                    }
+                }
+
                 CodeNodePtr truePart (evaluate(arguments[1]));
                 CodeNodePtr falsePart(evaluate(arguments[2]));
                 assert(truePart->getType() == falsePart->getType());
-                return cache(c, CodeNodePtr(new IfCodeNode(
-                                                truePart->getType(),
-                                                condition,
-                                                truePart,
-                                                falsePart)));
+                return makeIf(
+                    truePart->getType(),
+                    condition,
+                    truePart,
+                    falsePart);
+            }
 
-            } else {
+            default:
                 assert(!"Error Unknown Function Type!");
                 return CodeNodePtr();
-            }
-
-        } else if (REN_DYNAMIC_CAST(p, ArgumentNode*, c.get())) {
-            assert(!"Can't directly evaluate an ArgumentNode");
-            (void)p;
-            return CodeNodePtr();
-        } else if (REN_DYNAMIC_CAST(p, FunctionNode*, c.get())) {
-            assert(!"Can't directly evaluate a FunctionNode");
-            (void)p;
-            return CodeNodePtr();
-        } else {
-            //std::cout << typeid(c.get()).name() << std::endl;
-            assert(!"Error Unknown ConcreteNode!");
-            return CodeNodePtr();
         }
     }
 
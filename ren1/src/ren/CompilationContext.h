@@ -3,6 +3,7 @@
 
 
 #include <map>
+#include <vector>
 #include "CodeNode.h"
 #include "ConcreteNode.h"
 #include "Program.h"
@@ -14,7 +15,11 @@ namespace ren {
 
     class CompilationContext {
     public:
-        CompilationContext(ProgramPtr program);
+        /// Constants in the map take its values instead of the
+        /// program's.
+        CompilationContext(
+            ProgramPtr program,
+            const ConstantMap& constants = ConstantMap());
 
         ConcreteNodePtr instantiate(
             const string& name,
@@ -26,6 +31,111 @@ namespace ren {
         }
 
     private:
+        /**
+         * Structural identity of a CodeNode.  Two nodes with the same
+         * key compute the same value, so only one of them is built.
+         * Names carry no value: within a compilation, a name (or
+         * literal) always refers to the same value.
+         */
+        struct CodeNodeKey {
+            enum Kind {
+                NAME,
+                CALL,
+                IF,
+            };
+
+            CodeNodeKey(Kind kind_, const string& name_, Type type_)
+            : kind(kind_)
+            , name(name_)
+            , type(type_)
+            , tag(0)
+            , frequency(CONSTANT) {
+            }
+
+            bool operator<(const CodeNodeKey& rhs) const;
+
+            Kind kind;
+            string name;    ///< Input name or operator.
+            Type type;
+            int tag;        ///< Input type or call type.
+            Frequency frequency;
+            CodeNodeList children;
+        };
+
+        CodeNodePtr makeName(ValueNodePtr v);
+        CodeNodePtr makeCall(
+            Type type,
+            FunctionNodePtr f,
+            const CodeNodeList& arguments);
+        CodeNodePtr makeIf(
+            Type type,
+            CodeNodePtr condition,
+            CodeNodePtr truePart,
+            CodeNodePtr falsePart);
+
+        CodeNodePtr findValue(const CodeNodeKey& key);
+
+        /// Structural identity of a ConcreteNode, like CodeNodeKey.
+        struct ConcreteNodeKey {
+            enum Kind {
+                VALUE,
+                FUNCTION,
+                APPLICATION,
+            };
+
+            ConcreteNodeKey(Kind kind_, const string& name_, Type type_)
+            : kind(kind_)
+            , name(name_)
+            , type(type_)
+            , tag(0)
+            , frequency(CONSTANT) {
+            }
+
+            bool operator<(const ConcreteNodeKey& rhs) const;
+
+            Kind kind;
+            string name;    ///< Value or function name.
+            Type type;
+            int tag;        ///< Input type or call type.
+            Frequency frequency;
+            ConcreteNodeList children;
+        };
+
+        /// The first node seen with the same structure as node.
+        ConcreteNodePtr canonicalize(ConcreteNodePtr node);
+
+        typedef std::map<ConcreteNodePtr, ConcreteNodePtr> ReplacementMap;
+
+        typedef std::pair<ConcreteNodePtr, ConcreteNodeList> ApplicationKey;
+        typedef std::map<ApplicationKey, ConcreteNodePtr> ApplicationTable;
+
+        /// Applications are shared the same way CodeNodes are.
+        ConcreteNodePtr makeApplication(
+            ConcreteNodePtr function,
+            const ConcreteNodeList& arguments);
+
+        /**
+         * The body of ab with arguments substituted in.  Applying the
+         * same function to the same arguments twice yields the same
+         * node, so it is only evaluated once.
+         */
+        ConcreteNodePtr substitute(
+            AbstractionNodePtr ab,
+            const ConcreteNodeList& arguments);
+        ConcreteNodePtr copyAndReplace(
+            ConcreteNodePtr node,
+            ReplacementMap& rm);
+
+        /// Sorted, so lists merge in linear time.
+        typedef std::vector<ConcreteNode*> ArgumentList;
+
+        /// The ArgumentNodes node refers to, but not inside the
+        /// abstractions that bind them.
+        const ArgumentList& getFreeArguments(const ConcreteNodePtr& node);
+
+        /// evaluate() for an application, dispatched on its function.
+        CodeNodePtr evaluateApplication(ApplicationNode* a);
+
         ScopePtr _scope;
 
         CodeNodePtr cache(ConcreteNodePtr key, CodeNodePtr value) {
@@ -39,6 +149,19 @@ namespace ren {
 
         typedef std::map<ConcreteNodePtr, CodeNodePtr> EvaluationCache;
         EvaluationCache _evaluationCache;
+
+        typedef std::map<CodeNodeKey, CodeNodePtr> ValueNumberTable;
+        ValueNumberTable _valueNumbers;
+
+        ApplicationTable _applications;
+        ApplicationTable _substitutions;
+
+        typedef std::map<ConcreteNodePtr, ConcreteNodePtr> CanonicalMap;
+        CanonicalMap _canonicalNodes;
+        std::map<ConcreteNodeKey, ConcreteNodePtr> _canonicalKeys;
+
+        typedef std::map<ConcreteNodePtr, ArgumentList> FreeArgumentMap;
+        FreeArgumentMap _freeArguments;
     };
 
 }
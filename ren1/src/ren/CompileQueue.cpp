@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <sstream>
+#include <boost/bind.hpp>
+#include "CompileQueue.h"
+
+
+namespace ren {
+
+    bool PendingCompile::isReady() const {
+        boost::mutex::scoped_lock lock(_mutex);
+        return _result;
+    }
+
+
+    CompileResultPtr PendingCompile::getResult() const {
+        boost::mutex::scoped_lock lock(_mutex);
+        return _result;
+    }
+
+
+    string PendingCompile::getOutput() const {
+        boost::mutex::scoped_lock lock(_mutex);
+        return _output;
+    }
+
+
+    CompileResultPtr PendingCompile::wait() const {
+        boost::mutex::scoped_lock lock(_mutex);
+        while (!_result) {
+            _finished.wait(lock);
+        }
+        return _result;
+    }
+
+
+    void PendingCompile::finish(
+        CompileResultPtr result,
+        const string& output
+    ) {
+        boost::mutex::scoped_lock lock(_mutex);
+        _result = result;
+        _output = output;
+        _finished.notify_all();
+    }
+
+
+    CompileQueue::CompileQueue(unsigned threads)
+    : _running(0)
+    , _stopping(false) {
+        if (threads == 0) {
+            threads = std::max(1u, boost::thread::hardware_concurrency());
+        }
+        for (unsigned i = 0; i < threads; ++i) {
+            _workers.create_thread(boost::bind(&CompileQueue::run, this));
+        }
+    }
+
+
+    CompileQueue::~CompileQueue() {
+        {
+            boost::mutex::scoped_lock lock(_mutex);
+            _stopping = true;
+            _queued.notify_all();
+        }
+        _workers.join_all();
+    }
+
+
+    PendingCompilePtr CompileQueue::compileAsync(
+        ProgramPtr program,
+        const CompileOptions& options,
+        const CompileCallback& callback
+    ) {
+        Task task;
+        task.program = program;
+        task.options = options;
+        task.callback = callback;
+        task.pending.reset(new PendingCompile);
+
+        // insert() keeps the values the options already override.
+        const Program::InputList& constants = program->getConstants();
+        for (size_t i = 0; i < constants.size(); ++i) {
+            const string& name = constants[i].getName();
+            task.options.constants.insert(ConstantMap::value_type(
+                name, program->getConstantValue(name)));
+        }
+
+        boost::mutex::scoped_lock lock(_mutex);
+        _tasks.push_back(task);
+        _queued.notify_one();
+        return task.pending;
+    }
+
+
+    size_t CompileQueue::getPendingCount() const {
+        boost::mutex::scoped_lock lock(_mutex);
+        return _tasks.size() + _running;
+    }
+
+
+    bool CompileQueue::take(Task& task) {
+        boost::mutex::scoped_lock lock(_mutex);
+        while (_tasks.empty()) {
+            if (_stopping) {
+                return false;
+            }
+            _queued.wait(lock);
+        }
+        task = _tasks.front();
+        _tasks.pop_front();
+        ++_running;
+        return true;
+    }
+
+
+    void CompileQueue::run() {
+        Task task;
+        while (take(task)) {
+            std::ostringstream output;
+            CompileResultPtr result(new CompileResult(
+                compile(task.program, task.options, output)));
+
+            if (task.callback) {
+                task.callback(*result, output.str());
+            }
+            task.pending->finish(result, output.str());
+
+            // Don't keep the program alive until the next compile.
+            task = Task();
+
+            boost::mutex::scoped_lock lock(_mutex);
+            --_running;
+        }
+    }
+
+}
@@ -0,0 +1,100 @@
+#ifndef REN_COMPILE_QUEUE_H
+#define REN_COMPILE_QUEUE_H
+
+
+#include <deque>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include "Compiler.h"
+
+
+namespace ren {
+
+    /// A compile running on a CompileQueue.  Safe to poll or wait on
+    /// from any thread.
+    class PendingCompile : public boost::noncopyable {
+    public:
+        bool isReady() const;
+
+        /// Null until the compile finishes.
+        CompileResultPtr getResult() const;
+
+        /// What the compile wrote to its output.  Empty until it
+        /// finishes.
+        string getOutput() const;
+
+        /// Blocks until the compile finishes.
+        CompileResultPtr wait() const;
+
+    private:
+        friend class CompileQueue;
+
+        void finish(CompileResultPtr result, const string& output);
+
+        mutable boost::mutex _mutex;
+        mutable boost::condition _finished;
+        CompileResultPtr _result;
+        string _output;
+    };
+    typedef boost::shared_ptr<PendingCompile> PendingCompilePtr;
+
+    /// Called on the compiling thread with the result and what the
+    /// compile wrote to its output.  Must not throw.
+    typedef boost::function<void (const CompileResult&, const string&)>
+        CompileCallback;
+
+
+    /**
+     * Compiles programs on background threads, so an interactive
+     * application can keep drawing while it waits for new shaders.
+     * Compiles start in the order they're queued.
+     */
+    class CompileQueue : public boost::noncopyable {
+    public:
+        /// 0 threads means one per core.
+        explicit CompileQueue(unsigned threads = 0);
+
+        /// Finishes the compiles already queued before returning.
+        ~CompileQueue();
+
+        /**
+         * Queues a compile of the program with its current constant
+         * values.  They're copied into the options before returning,
+         * so the program's constants can change while it compiles,
+         * but nothing else about it may.
+         */
+        PendingCompilePtr compileAsync(
+            ProgramPtr program,
+            const CompileOptions& options = CompileOptions(),
+            const CompileCallback& callback = CompileCallback());
+
+        /// Compiles queued or running.
+        size_t getPendingCount() const;
+
+    private:
+        struct Task {
+            ProgramPtr program;
+            CompileOptions options;
+            CompileCallback callback;
+            PendingCompilePtr pending;
+        };
+
+        bool take(Task& task);
+        void run();
+
+        mutable boost::mutex _mutex;
+        boost::condition _queued;
+        std::deque<Task> _tasks;
+        size_t _running;
+        bool _stopping;
+
+        boost::thread_group _workers;
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,118 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+#include "Arena.h"
+#include "CompileStats.h"
+
+
+namespace ren {
+
+    static double now() {
+#ifdef _WIN32
+        LARGE_INTEGER frequency, counter;
+        QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&counter);
+        return double(counter.QuadPart) / frequency.QuadPart;
+#else
+        timeval tv;
+        gettimeofday(&tv, 0);
+        return tv.tv_sec + tv.tv_usec * 1e-6;
+#endif
+    }
+
+
+    const char* CompileStats::getPhaseName(Phase phase) {
+        switch (phase) {
+            case PARSE:          return "parse";
+            case VALIDATE:       return "validate";
+            case INSTANTIATE:    return "instantiate";
+            case EVALUATE:       return "evaluate";
+            case SPECIALIZE:     return "specialize";
+            case HOIST:          return "hoist";
+            case LIFT:           return "lift";
+            case SHARE:          return "share";
+            case SPLIT_BRANCHES: return "splitBranches";
+            case EMIT:           return "emit";
+            default: assert(!"Unknown phase"); return "<unknown>";
+        }
+    }
+
+
+    CompileStats::CompileStats()
+    : compiles(0)
+    , varyings(0)
+    , temporaries(0)
+    , uniforms(0)
+    , constants(0)
+    , derivedUniforms(0) {
+        for (size_t i = 0; i < PHASE_COUNT; ++i) {
+            seconds[i] = 0;
+            nodes[i] = 0;
+            bytes[i] = 0;
+        }
+    }
+
+
+    CompileStats& CompileStats::operator+=(const CompileStats& rhs) {
+        compiles += rhs.compiles;
+        for (size_t i = 0; i < PHASE_COUNT; ++i) {
+            seconds[i] += rhs.seconds[i];
+            nodes[i]   += rhs.nodes[i];
+            bytes[i]   += rhs.bytes[i];
+        }
+        varyings    += rhs.varyings;
+        temporaries += rhs.temporaries;
+        uniforms    += rhs.uniforms;
+        constants   += rhs.constants;
+        derivedUniforms += rhs.derivedUniforms;
+        return *this;
+    }
+
+
+    double CompileStats::getTotalSeconds() const {
+        double rv = 0;
+        for (size_t i = 0; i < PHASE_COUNT; ++i) {
+            rv += seconds[i];
+        }
+        return rv;
+    }
+
+
+    std::ostream& operator<<(std::ostream& os, const CompileStats& stats) {
+        os << stats.compiles << " compiles, "
+           << stats.getTotalSeconds() * 1000 << " ms\n";
+        for (size_t i = 0; i < CompileStats::PHASE_COUNT; ++i) {
+            CompileStats::Phase phase = CompileStats::Phase(i);
+            os << "  " << CompileStats::getPhaseName(phase) << ": "
+               << stats.seconds[i] * 1000 << " ms, "
+               << stats.nodes[i] << " nodes, "
+               << stats.bytes[i] << " bytes\n";
+        }
+        os << "  " << stats.varyings << " varyings, "
+           << stats.temporaries << " temporaries, "
+           << stats.uniforms << " uniforms, "
+           << stats.constants << " constants, "
+           << stats.derivedUniforms << " derived uniforms\n";
+        return os;
+    }
+
+
+    void PhaseTimer::start() {
+        Arena* arena = Arena::getCurrent();
+        _allocations = arena ? arena->getAllocationCount() : 0;
+        _bytes       = arena ? arena->getBytesUsed() : 0;
+        _start = now();
+    }
+
+
+    void PhaseTimer::stop() {
+        _stats->seconds[_phase] += now() - _start;
+        if (Arena* arena = Arena::getCurrent()) {
+            _stats->nodes[_phase] += arena->getAllocationCount() - _allocations;
+            _stats->bytes[_phase] += arena->getBytesUsed() - _bytes;
+        }
+    }
+
+}
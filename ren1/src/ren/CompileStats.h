@@ -0,0 +1,94 @@
+#ifndef REN_COMPILE_STATS_H
+#define REN_COMPILE_STATS_H
+
+
+#include <iostream>
+#include <boost/noncopyable.hpp>
+#include "Base.h"
+
+
+namespace ren {
+
+    /**
+     * Where compiles spend their time and memory.  compile() adds to
+     * the stats it's given, so passing the same CompileStats to many
+     * compiles aggregates them.
+     */
+    struct CompileStats {
+        enum Phase {
+            PARSE,
+            VALIDATE,
+            INSTANTIATE,
+            EVALUATE,
+            SPECIALIZE,
+            HOIST,
+            LIFT,
+            SHARE,
+            SPLIT_BRANCHES,
+            EMIT,
+
+            PHASE_COUNT
+        };
+
+        static const char* getPhaseName(Phase phase);
+
+        CompileStats();
+
+        CompileStats& operator+=(const CompileStats& rhs);
+
+        double getTotalSeconds() const;
+
+        size_t compiles;
+
+        /// Wall time spent in each phase.
+        double seconds[PHASE_COUNT];
+
+        /// Nodes and statements each phase allocated from the compile's
+        /// arena, and how many bytes the arena grew by for them.
+        size_t nodes[PHASE_COUNT];
+        size_t bytes[PHASE_COUNT];
+
+        size_t varyings;
+        size_t temporaries;  ///< Registers introduced by sharing.
+        size_t uniforms;     ///< Distinct names, over both stages.
+        size_t constants;    ///< Distinct names, over both stages.
+        size_t derivedUniforms;  ///< Hoisted to the CPU.
+    };
+
+    std::ostream& operator<<(std::ostream& os, const CompileStats& stats);
+
+
+    /// Adds the time and allocations of its lifetime to a phase.  Does
+    /// nothing if stats is null.
+    class PhaseTimer : public boost::noncopyable {
+    public:
+        PhaseTimer(CompileStats* stats, CompileStats::Phase phase)
+        : _stats(stats)
+        , _phase(phase) {
+            if (_stats) {
+                start();
+            }
+        }
+
+        ~PhaseTimer() {
+            if (_stats) {
+                stop();
+            }
+        }
+
+    private:
+        void start();
+        void stop();
+
+        CompileStats* _stats;
+        CompileStats::Phase _phase;
+
+        double _start;
+        size_t _allocations;
+        size_t _bytes;
+    };
+
+}
+
+
+#endif
@@ -1,4 +1,6 @@
+#include <set>
 #include <sstream>
+#include "Arena.h"
 #include "ShadeGraph.h"
 #include "CompilationContext.h"
 #include "Compiler.h"
@@ -13,14 +15,18 @@
 
 namespace ren {
 
-    ProgramPtr parse(std::istream& is) {
+    static ProgramPtr doParse(std::istream& is, CompileStats* stats) {
         antlr::ASTFactory parserFactory;
         ShaderLexer lexer(is);
         ShaderParser parser(lexer);
-        parser.initializeASTFactory(parserFactory);
-        parser.setASTFactory(&parserFactory);
-        parser.program();
+        {
+            PhaseTimer timer(stats, CompileStats::PARSE);
+            parser.initializeASTFactory(parserFactory);
+            parser.setASTFactory(&parserFactory);
+            parser.program();
+        }
 
+        PhaseTimer timer(stats, CompileStats::VALIDATE);
         if (antlr::RefAST ast = parser.getAST()) {
             ShaderValidator validator;
             return validator.program(ast);
@@ -31,6 +37,10 @@ namespace ren {
         }
     }
 
+    ProgramPtr parse(std::istream& is) {
+        return doParse(is, 0);
+    }
+
     ProgramPtr parse(const string& source) {
         std::istringstream is(source);
         return parse(is);
@@ -50,96 +60,248 @@ namespace ren {
     }
 
 
-    static CompileResult doCompile(
+    static void addOutput(
+        CompilationContext& cc,
+        ShadeGraph& sg,
+        const string& name,
+        CompileStats* stats
+    ) {
+        ConcreteNodePtr node;
+        {
+            PhaseTimer timer(stats, CompileStats::INSTANTIATE);
+            node = cc.instantiate(name);
+        }
+        if (node) {
+            requireType(name, node, VEC4);
+            PhaseTimer timer(stats, CompileStats::EVALUATE);
+            sg.outputs[name] = cc.evaluate(node);
+        }
+    }
+
+
+    template<typename VecType>
+    static void addNames(std::set<string>& names, const VecType& g) {
+        for (size_t i = 0; i < g.size(); ++i) {
+            names.insert(g[i].name);
+        }
+    }
+
+
+    static void countDeclarations(
+        const GLSLShader& vs,
+        const GLSLShader& fs,
+        CompileStats& stats
+    ) {
+        std::set<string> uniforms;
+        addNames(uniforms, vs.uniforms);
+        addNames(uniforms, fs.uniforms);
+
+        std::set<string> constants;
+        addNames(constants, vs.constants);
+        addNames(constants, fs.constants);
+
+        stats.varyings    += vs.varyings.size();
+        stats.temporaries += vs.getRegisterCount() + fs.getRegisterCount();
+        stats.uniforms    += uniforms.size();
+        stats.constants   += constants.size();
+    }
+
+
+    /// Returns the program that computes hoisted uniforms, if any.
+    static UniformProgramPtr doCompile(
         ProgramPtr program,
-        std::ostream& output
+        const CompileOptions& options,
+        GLSLSink& vertexShader,
+        GLSLSink& fragmentShader,
+        std::ostream& output,
+        CompileStats* stats
     ) {
-        CompilationContext cc(program);
+        // Declared first, so every node is destroyed before it.
+        Arena arena;
+        ArenaScope arenaScope(arena);
+
+        program->checkConstantValues(options.constants);
+        CompilationContext cc(program, options.constants);
 
         // Build shader output graph.
 
         ShadeGraph sg;
-        
+        sg.maxVaryings = options.maxVaryings;
+        sg.pixelsPerVertex = options.pixelsPerVertex;
+        if (options.reportPlacement) {
+            sg.placementReport = &output;
+        }
+        if (options.packUniforms) {
+            sg.uniformLayout = &program->getUniformLayout();
+        }
+
         if (program->hasDefinition("gl_Position")) {
-            ConcreteNodePtr gl_Position = cc.instantiate("gl_Position");
-            if (gl_Position) {
-                requireType("gl_Position", gl_Position, VEC4);
-                sg.outputs["gl_Position"] = cc.evaluate(gl_Position);
-            }
+            addOutput(cc, sg, "gl_Position", stats);
         }
 
         if (program->hasDefinition("gl_FragColor")) {
-            ConcreteNodePtr gl_FragColor = cc.instantiate("gl_FragColor");
-            if (gl_FragColor) {
-                requireType("gl_FragColor", gl_FragColor, VEC4);
-                sg.outputs["gl_FragColor"] = cc.evaluate(gl_FragColor);
-            }
+            addOutput(cc, sg, "gl_FragColor", stats);
+        }
+
+        {
+            PhaseTimer timer(stats, CompileStats::SPECIALIZE);
+            sg.specialize();
         }
 
-        sg.specialize();
+        UniformProgramPtr uniformProgram;
+        if (options.hoistUniforms) {
+            PhaseTimer timer(stats, CompileStats::HOIST);
+            uniformProgram.reset(new UniformProgram);
+            sg.hoistUniforms(*uniformProgram);
+            if (uniformProgram->getOutputs().empty()) {
+                uniformProgram.reset();
+            }
+        }
 
         // Split into vertex and fragment stages.
         GLSLShader vs, fs;
-        sg.generate(vs, fs);
+        {
+            PhaseTimer timer(stats, CompileStats::LIFT);
+            sg.generate(vs, fs);
+        }
 
         // Generate GLSL.
-        std::ostringstream vs_glsl;
-        std::ostringstream fs_glsl;
-        vs.generate(vs_glsl);
-        fs.generate(fs_glsl);
-
-        return CompileResult(
-            true,
-            vs_glsl.str(),
-            fs_glsl.str());
+        vs.generate(vertexShader, stats);
+        fs.generate(fragmentShader, stats);
+
+        if (stats) {
+            countDeclarations(vs, fs, *stats);
+            if (uniformProgram) {
+                stats->derivedUniforms += uniformProgram->getOutputs().size();
+            }
+        }
+
+        return uniformProgram;
     }
 
 
     static CompileResult doCompile(
-        const string& source,
-        std::ostream& output
+        ProgramPtr program,
+        const CompileOptions& options,
+        std::ostream& output,
+        CompileStats* stats
+    ) {
+        // Write straight into the result, so the text is never copied.
+        CompileResult rv(true);
+        StringSink vs(rv.vertexShader);
+        StringSink fs(rv.fragmentShader);
+        rv.uniformProgram = doCompile(program, options, vs, fs, output, stats);
+        if (options.packUniforms) {
+            rv.uniformLayout = program->getUniformLayout();
+        }
+        return rv;
+    }
+
+
+    static CompileResult doCompile(
+        std::istream& is,
+        const CompileOptions& options,
+        std::ostream& output,
+        CompileStats* stats
     ) {
-        ProgramPtr program = parse(source);
+        ProgramPtr program = doParse(is, stats);
         if (!program) {
             // No exceptions thrown, but no program generated.  Must be empty.
             return CompileResult(true);
         }
-        return doCompile(program, output);
+        return doCompile(program, options, output, stats);
     }
 
 
-    CompileResult compile(ProgramPtr program, std::ostream& output) {
-        static CompileResult FAILURE(false);
+    CompileResult compile(
+        ProgramPtr program,
+        const CompileOptions& options,
+        std::ostream& output,
+        CompileStats* stats
+    ) {
+        if (stats) {
+            ++stats->compiles;
+        }
 
         try {
-            return doCompile(program, output);
+            return doCompile(program, options, output, stats);
         }
         catch (const antlr::ANTLRException& e) {
             output << "ANTLR Exception: " << e.toString() << std::endl;
-            return FAILURE;
+            return CompileResult(false);
         }
         catch (const std::exception& e) {
             output << "Exception: " << e.what() << std::endl;
-            return FAILURE;
+            return CompileResult(false);
+        }
+
+    }
+
+
+    CompileResult compile(
+        ProgramPtr program,
+        const CompileOptions& options,
+        GLSLSink& vertexShader,
+        GLSLSink& fragmentShader,
+        std::ostream& output,
+        CompileStats* stats
+    ) {
+        if (stats) {
+            ++stats->compiles;
         }
 
+        try {
+            CompileResult rv(true);
+            rv.uniformProgram = doCompile(
+                program, options, vertexShader, fragmentShader, output, stats);
+            if (options.packUniforms) {
+                rv.uniformLayout = program->getUniformLayout();
+            }
+            return rv;
+        }
+        catch (const antlr::ANTLRException& e) {
+            output << "ANTLR Exception: " << e.toString() << std::endl;
+            return CompileResult(false);
+        }
+        catch (const std::exception& e) {
+            output << "Exception: " << e.what() << std::endl;
+            return CompileResult(false);
+        }
     }
 
 
-    CompileResult compile(const string& source, std::ostream& output) {
-        static CompileResult FAILURE(false);
+    CompileResult compile(
+        std::istream& is,
+        const CompileOptions& options,
+        std::ostream& output,
+        CompileStats* stats
+    ) {
+        if (stats) {
+            ++stats->compiles;
+        }
 
         try {
-            return doCompile(source, output);
+            return doCompile(is, options, output, stats);
         }
         catch (const antlr::ANTLRException& e) {
             output << "ANTLR Exception: " << e.toString() << std::endl;
-            return FAILURE;
+            return CompileResult(false);
         }
         catch (const std::exception& e) {
             output << "Exception: " << e.what() << std::endl;
-            return FAILURE;
+            return CompileResult(false);
         }
     }
 
+
+    CompileResult compile(
+        const string& source,
+        const CompileOptions& options,
+        std::ostream& output,
+        CompileStats* stats
+    ) {
+        std::istringstream is(source);
+        return compile(is, options, output, stats);
+    }
+
 }
@@ -3,8 +3,11 @@
 
 
 #include <iostream>
+#include "CompileStats.h"
+#include "GLSLWriter.h"
 #include "Program.h"
 #include "Types.h"
+#include "UniformProgram.h"
 
 
 namespace ren {
@@ -12,6 +15,53 @@ namespace ren {
     ProgramPtr parse(std::istream& is);
     ProgramPtr parse(const string& source);
 
+    /// Bumped whenever the same program and options could compile to
+    /// different shaders, so caches of compiled shaders can tell.
+    const unsigned COMPILER_VERSION = 1;
+
+    /**
+     * Optional transformations, and what to assume about the hardware
+     * and the meshes drawn.  The transformations change what the
+     * application has to provide, so they're all off by default.
+     */
+    struct CompileOptions {
+        CompileOptions()
+        : hoistUniforms(false)
+        , maxVaryings(8)
+        , pixelsPerVertex(8)
+        , reportPlacement(false)
+        , packUniforms(false) {
+        }
+
+        /// Values for some of the program's constants, used instead
+        /// of the ones set on it.  Threads can compile one program
+        /// with different values this way, without changing it.
+        ConstantMap constants;
+
+        /// Compute uniform-only subexpressions on the CPU, with
+        /// CompileResult::uniformProgram.
+        bool hoistUniforms;
+
+        /// vec4 varyings the hardware can interpolate.  Smaller ones
+        /// are packed together.  Compiling fails if a program needs
+        /// more.
+        unsigned maxVaryings;
+
+        /// Pixels drawn per vertex, on average.  Lower it for dense
+        /// meshes, where the vertex shader runs nearly as often as
+        /// the fragment shader.
+        float pixelsPerVertex;
+
+        /// Write to the output which expressions moved to the vertex
+        /// shader, and which didn't.
+        bool reportPlacement;
+
+        /// Read uniforms from one array of vec4s, laid out by
+        /// Program::getUniformLayout(), so Program::getUniformBuffer()
+        /// uploads them all at once.  Samplers stay separate.
+        bool packUniforms;
+    };
+
     struct CompileResult {
         CompileResult(bool s, const string& vs = "", const string& fs = "")
         : success(s)
@@ -22,14 +72,84 @@ namespace ren {
         bool success;
         string vertexShader;
         string fragmentShader;
+
+        /// Computes the uniforms hoisted out of the shaders, if any.
+        /// Run it whenever the uniforms it reads change.
+        UniformProgramPtr uniformProgram;
+
+        /// With packUniforms, where each uniform is in the array the
+        /// shaders declare as UniformLayout::ARRAY_NAME.  Empty
+        /// otherwise.
+        UniformLayout uniformLayout;
     };
 
+    /// Shared by everything that uses one compile's result.
+    typedef boost::shared_ptr<const CompileResult> CompileResultPtr;
+
+    /**
+     * If stats is given, each phase's time and allocations are added
+     * to it.
+     *
+     * Any number of threads may compile at once, whether their
+     * programs are distinct or the same.  A compile only reads its
+     * program, so nothing may change a shared program meanwhile: give
+     * each compile its own constant values through
+     * CompileOptions::constants instead.  Output streams and stats
+     * must not be shared between threads.
+     */
     CompileResult compile(ProgramPtr program,
-                          std::ostream& output = std::cerr);
+                          const CompileOptions& options,
+                          std::ostream& output = std::cerr,
+                          CompileStats* stats = 0);
+
+    /**
+     * Writes the shaders to the given sinks instead of the result, so
+     * callers can generate into buffers of their own without a copy.
+     * The result's shader strings are left empty.
+     */
+    CompileResult compile(ProgramPtr program,
+                          const CompileOptions& options,
+                          GLSLSink& vertexShader,
+                          GLSLSink& fragmentShader,
+                          std::ostream& output = std::cerr,
+                          CompileStats* stats = 0);
+
     CompileResult compile(const string& source,
-                          std::ostream& output = std::cerr);
+                          const CompileOptions& options,
+                          std::ostream& output = std::cerr,
+                          CompileStats* stats = 0);
+
+    inline CompileResult compile(ProgramPtr program,
+                                 std::ostream& output = std::cerr,
+                                 CompileStats* stats = 0) {
+        return compile(program, CompileOptions(), output, stats);
+    }
+
+    inline CompileResult compile(ProgramPtr program,
+                                 GLSLSink& vertexShader,
+                                 GLSLSink& fragmentShader,
+                                 std::ostream& output = std::cerr,
+                                 CompileStats* stats = 0) {
+        return compile(program, CompileOptions(),
+                       vertexShader, fragmentShader, output, stats);
+    }
+
+    inline CompileResult compile(const string& source,
+                                 std::ostream& output = std::cerr,
+                                 CompileStats* stats = 0) {
+        return compile(source, CompileOptions(), output, stats);
+    }
+
     CompileResult compile(std::istream& is,
-                          std::ostream& output = std::cerr);
+                          const CompileOptions& options,
+                          std::ostream& output = std::cerr,
+                          CompileStats* stats = 0);
+
+    inline CompileResult compile(std::istream& is,
+                                 std::ostream& output = std::cerr,
+                                 CompileStats* stats = 0) {
+        return compile(is, CompileOptions(), output, stats);
+    }
 
 }
 
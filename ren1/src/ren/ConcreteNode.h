@@ -4,6 +4,7 @@
 
 #include <sstream>
 #include <boost/shared_ptr.hpp>
+#include "Arena.h"
 #include "Errors.h"
 #include "Frequency.h"
 #include "Types.h"
@@ -24,23 +25,47 @@ namespace ren {
     typedef std::vector<ConcreteNodePtr> ConcreteNodeList;
 
 
-    class ConcreteNode {
+    class ConcreteNode : public ArenaObject {
     public:
+        /// Which subclass this is, for switches and REN_KIND_CAST.
+        enum Kind {
+            APPLICATION_NODE,
+            ABSTRACTION_NODE,
+            ARGUMENT_NODE,
+            IF_NODE,
+            FUNCTION_NODE,
+            VALUE_NODE,
+        };
+
+        ConcreteNode(Kind kind)
+        : _kind(kind) {
+        }
+
         // Hush gcc.
         virtual ~ConcreteNode() {
         }
 
+        Kind getKind() const {
+            return _kind;
+        }
+
         virtual string asStringTree() const = 0;
 
         virtual Type getType() const = 0;
         virtual Frequency getFrequency() const = 0;
+
+    private:
+        Kind _kind;
     };
 
 
     class ApplicationNode : public ConcreteNode {
     public:
+        static const Kind KIND = APPLICATION_NODE;
+
         ApplicationNode(ConcreteNodePtr function, ConcreteNodeList arguments)
-        : _function(function)
+        : ConcreteNode(KIND)
+        , _function(function)
         , _arguments(arguments) {
         }
 
@@ -82,8 +107,11 @@ namespace ren {
 
     class AbstractionNode : public ConcreteNode {
     public:
+        static const Kind KIND = ABSTRACTION_NODE;
+
         AbstractionNode(ConcreteNodeList replacements, ConcreteNodePtr inside)
-        : _replacements(replacements)
+        : ConcreteNode(KIND)
+        , _replacements(replacements)
         , _inside(inside) {
             assert(_replacements.size() >= 1);
         }
@@ -126,8 +154,11 @@ namespace ren {
 
     class ArgumentNode : public ConcreteNode {
     public:
+        static const Kind KIND = ARGUMENT_NODE;
+
         ArgumentNode(Type type)
-        : _type(type) {
+        : ConcreteNode(KIND)
+        , _type(type) {
         }
 
         string asStringTree() const {
@@ -154,8 +185,11 @@ namespace ren {
 
     class IfNode : public ConcreteNode {
     public:
+        static const Kind KIND = IF_NODE;
+
         IfNode(Type type)
-        : _type(type) {
+        : ConcreteNode(KIND)
+        , _type(type) {
         }
 
         string asStringTree() const {
@@ -184,12 +218,15 @@ namespace ren {
             FUNCTION,
         };
 
+        static const Kind KIND = FUNCTION_NODE;
+
         FunctionNode(
             const string& name,
             Type type,
             CallType callType,
             Linearity linearity)
-        : _name(name)
+        : ConcreteNode(KIND)
+        , _name(name)
         , _type(type)
         , _callType(callType)
         , _linearity(linearity) {
@@ -238,13 +275,16 @@ namespace ren {
             VARYING,
         };
 
+        static const Kind KIND = VALUE_NODE;
+
         ValueNode(const string& name,
                   Type type,
                   Frequency frequency,
                   ValuePtr value,
                   InputType inputType = BUILTIN,
                   bool isFunction = false)
-        : _name(name)
+        : ConcreteNode(KIND)
+        , _name(name)
         , _type(type)
         , _frequency(frequency)
         , _value(value)
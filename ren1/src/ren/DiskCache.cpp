@@ -0,0 +1,454 @@
+#ifdef _WIN32
+#include <iterator>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+#include <antlr/ANTLRException.hpp>
+#include "DiskCache.h"
+#include "Errors.h"
+
+
+namespace ren {
+
+    namespace {
+
+        const boost::uint32_t MAGIC = 0x434e4552;  // "RENC"
+        const boost::uint32_t FILE_VERSION = 1;
+        const size_t HEADER_SIZE = 4 * sizeof(boost::uint32_t);
+
+
+        boost::uint32_t hash32(const char* data, size_t size) {
+            boost::uint32_t hash = 2166136261u;
+            for (size_t i = 0; i < size; ++i) {
+                hash ^= static_cast<unsigned char>(data[i]);
+                hash *= 16777619u;
+            }
+            return hash;
+        }
+
+
+        boost::uint64_t hash64(const string& s) {
+            boost::uint64_t hash = 14695981039346656037ull;
+            for (size_t i = 0; i < s.size(); ++i) {
+                hash ^= static_cast<unsigned char>(s[i]);
+                hash *= 1099511628211ull;
+            }
+            return hash;
+        }
+
+
+        boost::mutex& getTemporaryMutex() {
+            static boost::mutex mutex;
+            return mutex;
+        }
+
+        /// Makes sure the mutex exists before main() can start threads.
+        boost::mutex& temporaryMutex = getTemporaryMutex();
+
+
+        /// A name next to path that no other writer, in this process
+        /// or another, is using.
+        string getTemporaryPath(const string& path) {
+            static unsigned long count = 0;
+            unsigned long n;
+            {
+                boost::mutex::scoped_lock lock(getTemporaryMutex());
+                n = ++count;
+            }
+
+#ifdef _WIN32
+            int pid = _getpid();
+#else
+            int pid = getpid();
+#endif
+            std::ostringstream os;
+            os << path << "." << pid << "." << n << ".tmp";
+            return os.str();
+        }
+
+
+        /// Appends native-endian binary to a string.  Files aren't
+        /// meant to move between machines; one that does fails its
+        /// magic check.
+        class Writer {
+        public:
+            Writer(string& out)
+            : _out(out) {
+            }
+
+            void write(boost::uint32_t v) {
+                _out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+            }
+
+            void write(const string& s) {
+                write(boost::uint32_t(s.size()));
+                _out += s;
+            }
+
+        private:
+            string& _out;
+        };
+
+
+        /// Reads what Writer wrote.  Each read returns false, instead
+        /// of reading past the end, if the data is cut short.
+        class Reader {
+        public:
+            Reader(const char* begin, const char* end)
+            : _p(begin)
+            , _end(end) {
+            }
+
+            bool read(boost::uint32_t& v) {
+                if (size_t(_end - _p) < sizeof(v)) {
+                    return false;
+                }
+                memcpy(&v, _p, sizeof(v));
+                _p += sizeof(v);
+                return true;
+            }
+
+            bool read(string& s) {
+                boost::uint32_t size;
+                if (!read(size) || size_t(_end - _p) < size) {
+                    return false;
+                }
+                s.assign(_p, size);
+                _p += size;
+                return true;
+            }
+
+            bool atEnd() const {
+                return _p == _end;
+            }
+
+        private:
+            const char* _p;
+            const char* _end;
+        };
+
+
+        /// A whole file's contents, mapped into memory where the
+        /// platform allows.
+        class MappedFile : public boost::noncopyable {
+        public:
+            MappedFile(const string& path)
+            : _data(0)
+            , _size(0) {
+#ifdef _WIN32
+                std::ifstream is(path.c_str(), std::ios::binary);
+                if (is) {
+                    _contents.assign(std::istreambuf_iterator<char>(is),
+                                     std::istreambuf_iterator<char>());
+                    _data = _contents.data();
+                    _size = _contents.size();
+                }
+#else
+                int fd = open(path.c_str(), O_RDONLY);
+                if (fd == -1) {
+                    return;
+                }
+                struct stat st;
+                if (fstat(fd, &st) == 0 && st.st_size > 0) {
+                    void* p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE,
+                                   fd, 0);
+                    if (p != MAP_FAILED) {
+                        _data = static_cast<const char*>(p);
+                        _size = st.st_size;
+                    }
+                }
+                close(fd);
+#endif
+            }
+
+            ~MappedFile() {
+#ifndef _WIN32
+                if (_data) {
+                    munmap(const_cast<char*>(_data), _size);
+                }
+#endif
+            }
+
+            const char* getData() const {
+                return _data;
+            }
+
+            size_t getSize() const {
+                return _size;
+            }
+
+        private:
+            const char* _data;
+            size_t _size;
+#ifdef _WIN32
+            string _contents;
+#endif
+        };
+
+
+        void writeValue(Writer& w, const Value& v) {
+            Type type = v.getType();
+            size_t arity = getArity(type);
+            Type elementType = getElementType(type);
+
+            w.write(type.getName());
+            for (size_t i = 0; i < arity; ++i) {
+                boost::uint32_t bits;
+                if (elementType == FLOAT) {
+                    memcpy(&bits, v.asFloatVec() + i, sizeof(bits));
+                } else if (elementType == BOOL) {
+                    bits = v.asBoolVec()[i];
+                } else {
+                    bits = v.asIntVec()[i];
+                }
+                w.write(bits);
+            }
+        }
+
+
+        CompileResult compileSource(
+            const string& source,
+            const CompileOptions& options,
+            std::ostream& output
+        ) {
+            ProgramPtr program;
+            try {
+                program = parse(source);
+            }
+            catch (const antlr::ANTLRException& e) {
+                output << "ANTLR Exception: " << e.toString() << std::endl;
+                return CompileResult(false);
+            }
+            catch (const std::exception& e) {
+                output << "Exception: " << e.what() << std::endl;
+                return CompileResult(false);
+            }
+            if (!program) {
+                // No exceptions thrown, but no program generated.  Must
+                // be empty.
+                return CompileResult(true);
+            }
+
+            return ren::compile(program, options, output);
+        }
+
+    }
+
+
+    DiskCache::DiskCache(
+        const string& directory,
+        const CompileOptions& options
+    )
+    : _directory(directory)
+    , _options(options)
+    , _hits(0)
+    , _misses(0) {
+    }
+
+
+    CompileResult DiskCache::compile(
+        const string& source,
+        const ConstantMap& constants,
+        std::ostream& output
+    ) {
+        CompileOptions options = getOptions(constants);
+        string key = getKey(source, options);
+        string path = getPath(key);
+
+        CompileResult rv(false);
+        if (load(path, key, rv)) {
+            ++_hits;
+            return rv;
+        }
+
+        ++_misses;
+        rv = compileSource(source, options, output);
+        if (rv.success && !rv.uniformProgram) {
+            save(path, key, rv);
+        }
+        return rv;
+    }
+
+
+    CompileOptions DiskCache::getOptions(
+        const ConstantMap& constants
+    ) const {
+        CompileOptions rv(_options);
+        rv.constants = constants;
+        rv.constants.insert(
+            _options.constants.begin(), _options.constants.end());
+        return rv;
+    }
+
+
+    string DiskCache::getKey(
+        const string& source,
+        const CompileOptions& options
+    ) const {
+        string key;
+        Writer w(key);
+
+        w.write(COMPILER_VERSION);
+
+        // Everything but reportPlacement can change the shaders.
+        boost::uint32_t pixelsPerVertex;
+        memcpy(&pixelsPerVertex, &options.pixelsPerVertex,
+               sizeof(pixelsPerVertex));
+        w.write(boost::uint32_t(options.hoistUniforms));
+        w.write(boost::uint32_t(options.maxVaryings));
+        w.write(pixelsPerVertex);
+        w.write(boost::uint32_t(options.packUniforms));
+
+        w.write(source);
+
+        w.write(boost::uint32_t(options.constants.size()));
+        ConstantMap::const_iterator i = options.constants.begin();
+        for (; i != options.constants.end(); ++i) {
+            w.write(i->first);
+            writeValue(w, *i->second);
+        }
+        return key;
+    }
+
+
+    string DiskCache::getPath(const string& key) const {
+        char name[32];
+        sprintf(name, "%016llx.renc",
+                static_cast<unsigned long long>(hash64(key)));
+
+        string rv = _directory;
+        if (!rv.empty() && rv[rv.size() - 1] != '/') {
+            rv += '/';
+        }
+        return rv + name;
+    }
+
+
+    bool DiskCache::load(
+        const string& path,
+        const string& key,
+        CompileResult& result
+    ) const {
+        MappedFile file(path);
+        if (file.getSize() < HEADER_SIZE) {
+            return false;
+        }
+
+        Reader header(file.getData(), file.getData() + HEADER_SIZE);
+        boost::uint32_t magic, version, checksum, size;
+        header.read(magic);
+        header.read(version);
+        header.read(checksum);
+        header.read(size);
+
+        const char* payload = file.getData() + HEADER_SIZE;
+        if (magic != MAGIC ||
+            version != FILE_VERSION ||
+            size != file.getSize() - HEADER_SIZE ||
+            checksum != hash32(payload, size)
+        ) {
+            return false;
+        }
+
+        Reader r(payload, payload + size);
+        string storedKey;
+        if (!r.read(storedKey) || storedKey != key) {
+            return false;
+        }
+
+        CompileResult rv(true);
+        boost::uint32_t entries;
+        if (!r.read(rv.vertexShader) ||
+            !r.read(rv.fragmentShader) ||
+            !r.read(entries)
+        ) {
+            return false;
+        }
+
+        try {
+            for (boost::uint32_t i = 0; i < entries; ++i) {
+                string name, type;
+                boost::uint32_t offset;
+                if (!r.read(name) || !r.read(type) || !r.read(offset)) {
+                    return false;
+                }
+                rv.uniformLayout.add(name, getTypeFromString(type));
+                const UniformLayout::Entry* e = rv.uniformLayout.find(name);
+                if (!e || e->offset != offset) {
+                    return false;
+                }
+            }
+        }
+        catch (const CompileError&) {
+            // A type this version doesn't know.
+            return false;
+        }
+
+        if (!r.atEnd()) {
+            return false;
+        }
+        result = rv;
+        return true;
+    }
+
+
+    void DiskCache::save(
+        const string& path,
+        const string& key,
+        const CompileResult& result
+    ) const {
+        string payload;
+        Writer w(payload);
+        w.write(key);
+        w.write(result.vertexShader);
+        w.write(result.fragmentShader);
+
+        const UniformLayout::EntryList& entries =
+            result.uniformLayout.getEntries();
+        w.write(boost::uint32_t(entries.size()));
+        for (size_t i = 0; i < entries.size(); ++i) {
+            w.write(entries[i].name);
+            w.write(entries[i].type.getName());
+            w.write(boost::uint32_t(entries[i].offset));
+        }
+
+        string file;
+        Writer header(file);
+        header.write(MAGIC);
+        header.write(FILE_VERSION);
+        header.write(hash32(payload.data(), payload.size()));
+        header.write(boost::uint32_t(payload.size()));
+        file += payload;
+
+        // Write the whole file under another name first, so readers
+        // never see half of one.  The cache is only an optimization,
+        // so failing to write it isn't an error.
+        string temporary = getTemporaryPath(path);
+        {
+            std::ofstream os(temporary.c_str(), std::ios::binary);
+            os.write(file.data(), file.size());
+            os.close();
+            if (!os) {
+                std::remove(temporary.c_str());
+                return;
+            }
+        }
+#ifdef _WIN32
+        std::remove(path.c_str());
+#endif
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::remove(temporary.c_str());
+        }
+    }
+
+}
@@ -0,0 +1,81 @@
+#ifndef REN_DISK_CACHE_H
+#define REN_DISK_CACHE_H
+
+
+#include <iostream>
+#include <boost/noncopyable.hpp>
+#include "Compiler.h"
+#include "Program.h"
+
+
+namespace ren {
+
+    /**
+     * Compiled shaders saved in a directory, so later runs can load
+     * them without parsing or compiling.  Each file is named by a hash
+     * of the source text, the constant values, the options and
+     * COMPILER_VERSION, and holds all of them, so a collision or a
+     * stale file is just a miss.  A checksum catches truncated or
+     * corrupt files.
+     *
+     * Failed compiles aren't saved, so their errors are written every
+     * time.  Neither are results with a uniform program: only the
+     * shaders and the uniform layout are stored.
+     */
+    class DiskCache : public boost::noncopyable {
+    public:
+        /// Override the options' constants.  Constants given in
+        /// neither keep their defaults.
+        typedef ren::ConstantMap ConstantMap;
+
+        /// The directory must already exist.
+        explicit DiskCache(
+            const string& directory,
+            const CompileOptions& options = CompileOptions());
+
+        /// Loads the result of compiling source with the given
+        /// constants, or compiles and saves it.
+        CompileResult compile(
+            const string& source,
+            const ConstantMap& constants,
+            std::ostream& output = std::cerr);
+
+        /// The file that holds, or would hold, the result.
+        string getPath(const string& source,
+                       const ConstantMap& constants) const {
+            return getPath(getKey(source, getOptions(constants)));
+        }
+
+        size_t getHits() const {
+            return _hits;
+        }
+
+        size_t getMisses() const {
+            return _misses;
+        }
+
+    private:
+        /// The options to compile with: the given constants override
+        /// the options' ones.
+        CompileOptions getOptions(const ConstantMap& constants) const;
+
+        string getKey(const string& source,
+                      const CompileOptions& options) const;
+        string getPath(const string& key) const;
+
+        bool load(const string& path, const string& key,
+                  CompileResult& result) const;
+        void save(const string& path, const string& key,
+                  const CompileResult& result) const;
+
+        string _directory;
+        CompileOptions _options;
+
+        size_t _hits;
+        size_t _misses;
+    };
+
+}
+
+
+#endif
@@ -1,16 +1,20 @@
+#include <set>
 #include <sstream>
 #include "GLSLShader.h"
 
 
 namespace ren {
 
+    typedef std::set<CodeNode*> CodeNodeSet;
+
+
     void countReferences(
-        CodeNodePtr node,
+        const CodeNodePtr& node,
         ReferenceMap& refs,
         const ReferencePath& path
     ) {
         refs[node].push_back(path);
-        CodeNodeList children = node->getChildren();
+        const CodeNodeList& children = node->getChildren();
         for (size_t i = 0; i < children.size(); ++i) {
             countReferences(children[i], refs, path);
         }
@@ -29,7 +33,7 @@ namespace ren {
             countReferences(e, refs, path);
         }
         
-        StatementList children = statement->getChildren();
+        const StatementList& children = statement->getChildren();
         for (size_t i = 0; i < children.size(); ++i) {
             doCountReferences(children[i], refs, path);
         }
@@ -42,28 +46,30 @@ namespace ren {
 
 
     CodeNodePtr findMultiplyReferenced(
-        CodeNodePtr node,
+        const CodeNodePtr& node,
         const ReferenceMap& refs
     ) {
         assert(node);
 
-        ReferenceMap::const_iterator it = refs.find(node);
-
-        if (REN_DYNAMIC_CAST_PTR(p, CallCodeNode, node)) {
-            if (it != refs.end() && it->second.size() > 1) {
-                return p;
-            }
-        } else if (REN_DYNAMIC_CAST_PTR(p, IfCodeNode, node)) {
-            if (it != refs.end() && it->second.size() > 1) {
-                return p;
+        switch (node->getKind()) {
+            case CodeNode::CALL_CODE_NODE:
+            case CodeNode::IF_CODE_NODE: {
+                ReferenceMap::const_iterator it = refs.find(node);
+                if (it != refs.end() && it->second.size() > 1) {
+                    return node;
+                }
+                break;
             }
-        } else if (REN_DYNAMIC_CAST_PTR(p, NameCodeNode, node)) {
-            // Do nothing.
-        } else {
-            assert(!"Unknown code node type");
+
+            case CodeNode::NAME_CODE_NODE:
+                // Do nothing.
+                break;
+
+            default:
+                assert(!"Unknown code node type");
         }
 
-        CodeNodeList args = node->getChildren();
+        const CodeNodeList& args = node->getChildren();
         for (size_t i = 0; i < args.size(); ++i) {
             CodeNodePtr c = findMultiplyReferenced(args[i], refs);
             if (c) {
@@ -86,7 +92,7 @@ namespace ren {
             }
         }
 
-        StatementList children = stmt->getChildren();
+        const StatementList& children = stmt->getChildren();
         for (size_t i = 0; i < children.size(); ++i) {
             if (CodeNodePtr f = findMultiplyReferenced(children[i], refs)) {
                 return f;
@@ -97,175 +103,218 @@ namespace ren {
     }
 
 
-    CodeNodePtr findInterpolatable(CodeNodePtr node) {
-        if (REN_DYNAMIC_CAST_PTR(p, CallCodeNode, node)) {
-            if (p->canInterpolate()) {
-                return p;
-            }
-        } else if (REN_DYNAMIC_CAST_PTR(p, NameCodeNode, node)) {
-            if (p->getInputType() == ValueNode::BUILTIN &&
-                p->getFrequency() == VERTEX
-            ) {
-                return p;
-            }
+    CodeNodePtr copy(CodeNodePtr node, CopyMap& copies) {
+        assert(node);
+
+        CopyMap::iterator i = copies.find(node);
+        if (i != copies.end()) {
+            return i->second;
         }
 
         CodeNodeList args = node->getChildren();
         for (size_t i = 0; i < args.size(); ++i) {
-            CodeNodePtr c = findInterpolatable(args[i]);
-            if (c) {
-                return c;
-            }
+            args[i] = copy(args[i], copies);
         }
 
-        return CodeNodePtr();
-    }
-
-
-    CodeNodePtr findInterpolatable(StatementPtr stmt) {
-        if (CodeNodePtr e = stmt->getExpression()) {
-            if (CodeNodePtr f = findInterpolatable(e)) {
-                return f;
+        CodeNodePtr rv;
+        switch (node->getKind()) {
+            case CodeNode::CALL_CODE_NODE: {
+                CallCodeNode* p = static_cast<CallCodeNode*>(node.get());
+                rv.reset(new CallCodeNode(
+                             p->getType(),
+                             p->getCallType(),
+                             p->getOperator(),
+                             args,
+                             p->getLinearity()));
+                break;
             }
-        }
 
-        StatementList children = stmt->getChildren();
-        for (size_t i = 0; i < children.size(); ++i) {
-            if (CodeNodePtr f = findInterpolatable(children[i])) {
-                return f;
+            case CodeNode::IF_CODE_NODE:
+                rv.reset(new IfCodeNode(
+                             node->getType(), args[0], args[1], args[2]));
+                break;
+
+            case CodeNode::NAME_CODE_NODE: {
+                NameCodeNode* p = static_cast<NameCodeNode*>(node.get());
+                rv.reset(new NameCodeNode(
+                             p->getName(),
+                             p->getType(),
+                             p->getFrequency(),
+                             p->getValue(),
+                             p->getInputType()));
+                break;
             }
-        }
 
-        return CodeNodePtr();        
+            default:
+                assert(!"Unknown code node type");
+        }
+        return copies[node] = rv;
     }
 
 
-    IfCodeNodePtr findBranch(CodeNodePtr node) {
-        assert(node);
+    namespace {
 
-        if (REN_DYNAMIC_CAST_PTR(p, IfCodeNode, node)) {
-            return p;
-        }
+        const int NO_STATEMENT       = -1;
+        const int SEVERAL_STATEMENTS = -2;
 
-        CodeNodeList args = node->getChildren();
-        for (size_t i = 0; i < args.size(); ++i) {
-            IfCodeNodePtr c = findBranch(args[i]);
-            if (c) {
-                return c;
+        /// What the sharing pass knows about one code node.
+        struct ShareInfo {
+            ShareInfo()
+            : visited(false)
+            , named(false)
+            , defined(false)
+            , shared(false)
+            , uses(0)
+            , statement(NO_STATEMENT) {
             }
-        }
-        return IfCodeNodePtr();        
-    }
 
+            bool visited;
+            bool named;
+            bool defined;
 
-    IfCodeNodePtr findBranch(StatementPtr stmt, StatementPtr& ref) {
-        assert(stmt);
+            /// Is this node computed once into a register?
+            bool shared;
 
-        if (CodeNodePtr e = stmt->getExpression()) {
-            if (IfCodeNodePtr f = findBranch(e)) {
-                ref = stmt;
-                return f;
-            }
-        }
+            /// Occurrences in the output, once shared ancestors have
+            /// been replaced by their registers.
+            unsigned uses;
 
-        StatementList children = stmt->getChildren();
-        for (size_t i = 0; i < children.size(); ++i) {
-            if (IfCodeNodePtr f = findBranch(children[i], ref)) {
-                return f;
+            /// Index of the top-level statement that uses this node.
+            int statement;
+
+            CodeNodePtr reference;
+        };
+        typedef std::map<CodeNode*, ShareInfo> ShareMap;
+
+
+        bool canShare(CodeNode* node) {
+            switch (node->getKind()) {
+                case CodeNode::CALL_CODE_NODE: return true;
+                case CodeNode::IF_CODE_NODE:   return true;
+                case CodeNode::NAME_CODE_NODE: return false;
+                default:
+                    assert(!"Unknown code node type");
+                    return false;
             }
         }
 
-        return IfCodeNodePtr();        
-    }
 
+        void addUse(ShareInfo& info, unsigned count, int statement) {
+            info.uses += count;
+            if (info.statement == NO_STATEMENT) {
+                info.statement = statement;
+            } else if (info.statement != statement) {
+                info.statement = SEVERAL_STATEMENTS;
+            }
+        }
 
 
-    void replace(CodeNodePtr in, CodeNodePtr node, CodeNodePtr with) {
-        assert(in);
-        assert(node);
-        assert(with);
-        
-        CodeNodeList& args = in->getChildren();
-        for (size_t i = 0; i < args.size(); ++i) {
-            if (args[i] == node) {
-                args[i] = with;
-            } else {
-                replace(args[i], node, with);
+        /// Statements with expressions, in program order.
+        void getExpressionStatements(StatementPtr st, StatementList& result) {
+            if (st->getExpression()) {
+                result.push_back(st);
+            }
+            StatementList& children = st->getChildren();
+            for (size_t i = 0; i < children.size(); ++i) {
+                getExpressionStatements(children[i], result);
             }
         }
-    }
 
 
-    void replace(StatementPtr st, CodeNodePtr node, CodeNodePtr with) {
-        assert(st);
-        assert(node);
-        assert(with);
+        /// Post-order: every node comes after all of its children.
+        void sortTopologically(
+            CodeNodePtr node,
+            ShareMap& info,
+            CodeNodeList& order
+        ) {
+            ShareInfo& i = info[node.get()];
+            if (i.visited) {
+                return;
+            }
+            i.visited = true;
 
-        if (CodeNodePtr e = st->getExpression()) {
-            if (e == node) {
-                st->setExpression(with);
-            } else {
-                replace(e, node, with);
+            const CodeNodeList& children = node->getChildren();
+            for (size_t c = 0; c < children.size(); ++c) {
+                sortTopologically(children[c], info, order);
             }
+            order.push_back(node);
         }
 
-        StatementList children = st->getChildren();
-        for (size_t i = 0; i < children.size(); ++i) {
-            replace(children[i], node, with);
-        }       
-    }
-
 
-    void replace(StatementPtr& in, StatementPtr st, StatementPtr with) {
-        assert(in);
-        assert(st);
-        assert(with);
+        /**
+         * Emits the register definitions for shared nodes, each one
+         * ahead of everything that reads it.
+         */
+        class DefinitionWriter {
+        public:
+            DefinitionWriter(ShareMap& info, StatementList& output)
+            : _info(info)
+            , _output(output) {
+            }
 
-        if (in == st) {
-            in = with;
-            return;
-        }
+            /// Define the registers that node reads.
+            void require(CodeNodePtr node) {
+                if (_info[node.get()].shared) {
+                    define(node);
+                } else {
+                    const CodeNodeList& children = node->getChildren();
+                    for (size_t i = 0; i < children.size(); ++i) {
+                        require(children[i]);
+                    }
+                }
+            }
 
-        StatementList& children = in->getChildren();
-        for (size_t i = 0; i < children.size(); ++i) {
-            replace(children[i], st, with);
-        }       
-    }
+            void define(CodeNodePtr node) {
+                ShareInfo& i = _info[node.get()];
+                assert(i.shared);
+                if (i.defined) {
+                    return;
+                }
+                i.defined = true;
+
+                const CodeNodeList& children = node->getChildren();
+                for (size_t c = 0; c < children.size(); ++c) {
+                    require(children[c]);
+                }
+
+                REN_KIND_CAST(name, NameCodeNode, i.reference.get());
+                assert(name);
+
+                AssignmentPtr ns(new Assignment);
+                ns->define = true;
+                ns->lhs = name->getName();
+                ns->setExpression(node);
+                _output.push_back(ns);
+            }
 
+        private:
+            ShareMap& _info;
+            StatementList& _output;
+        };
 
-    ReferencePath getCommonPrefix(
-        const ReferencePath& p1,
-        const ReferencePath& p2
-    ) {
-        size_t i = 0;
-        while (i < p1.size() && i < p2.size() && p1[i] == p2[i]) {
-            ++i;
-        }
-        return ReferencePath(p1.begin(), p1.begin() + i);
     }
 
 
-    ReferencePath getCommonPrefix(const ReferenceList& rl) {
-        assert(rl.size() >= 2);
-        ReferencePath prefix = getCommonPrefix(rl[0], rl[1]);
-        for (size_t i = 2; i < rl.size(); ++i) {
-            prefix = getCommonPrefix(prefix, rl[i]);
+    /// Appends statements to output, with the blocks among them
+    /// replaced by what they hold.
+    static void flattenBlocks(
+        const StatementList& statements,
+        StatementList& output
+    ) {
+        for (size_t i = 0; i < statements.size(); ++i) {
+            if (REN_KIND_CAST_PTR(ib, Block, statements[i])) {
+                flattenBlocks(ib->getChildren(), output);
+            } else {
+                output.push_back(statements[i]);
+            }
         }
-        return prefix;
     }
 
 
     void removeRedundantBlocks(BlockPtr b) {
-        StatementList& children = b->getChildren();
-        for (size_t i = 0; i < children.size(); ++i) {
-            if (REN_DYNAMIC_CAST_PTR(ib, Block, children[i])) {
-                removeRedundantBlocks(ib);
-                StatementList sl = ib->getChildren();
-                children.erase(children.begin() + i);
-                children.insert(children.begin() + i, sl.begin(), sl.end());
-                --i;
-            }
-        }
+        StatementList statements;
+        flattenBlocks(b->getChildren(), statements);
+        b->getChildren().swap(statements);
     }
 
 
@@ -276,25 +325,32 @@ namespace ren {
     }
 
     template<typename VecType>
-    void writeGlobalArray(std::ostream& os, const string& prefix, const VecType& g) {
+    void writeGlobalArray(GLSLWriter& w, const string& prefix, const VecType& g) {
         for (size_t i = 0; i < g.size(); ++i) {
-            os << prefix << g[i].type << " " << g[i].name << ";\n";
+            w << prefix << g[i].type << " " << g[i].name << ";\n";
         }
     }
 
 
-    void GLSLShader::generate(std::ostream& os) {
-        // Turn shared expression nodes into precalculated variables.
-        share();
+    void GLSLShader::generate(GLSLSink& sink, CompileStats* stats) {
+        {
+            // Turn shared expression nodes into precalculated variables.
+            PhaseTimer timer(stats, CompileStats::SHARE);
+            share();
+        }
 
-        // First, we need to turn If nodes into separate statements.
-        splitBranches();
+        {
+            // First, we need to turn If nodes into separate statements.
+            PhaseTimer timer(stats, CompileStats::SPLIT_BRANCHES);
+            splitBranches();
 
-        // Sharing set up a lot of redundant (and incorrectly
-        // scope-restricting) block nodes.  Let's remove those.
-        removeRedundantBlocks(main);
+            // Sharing set up a lot of redundant (and incorrectly
+            // scope-restricting) block nodes.  Let's remove those.
+            removeRedundantBlocks(main);
+        }
 
-        output(os);
+        PhaseTimer timer(stats, CompileStats::EMIT);
+        output(sink);
     }
 
 
@@ -303,139 +359,251 @@ namespace ren {
     }
 
 
-    void GLSLShader::output(std::ostream& os) {
+    void GLSLShader::output(GLSLSink& sink) {
         std::sort(constants .begin(), constants .end(), compare);
         std::sort(uniforms  .begin(), uniforms  .end(), compare);
         std::sort(attributes.begin(), attributes.end(), compare);
         std::sort(varyings  .begin(), varyings  .end(), compare);
 
+        GLSLWriter w(sink);
+
         // Write constants with initializers.
         for (size_t i = 0; i < constants.size(); ++i) {
             Constant& c = constants[i];
             string init = c.value->asString();
-            os << "const " << c.type << " " << c.name << " = "
-               << init << ";\n";
+            w << "const " << c.type << " " << c.name << " = "
+              << init << ";\n";
         }
 
-        writeGlobalArray(os, "uniform ", uniforms);
-        writeGlobalArray(os, "attribute ", attributes);
-        writeGlobalArray(os, "varying ", varyings);
+        writeGlobalArray(w, "uniform ", uniforms);
+        writeGlobalArray(w, "attribute ", attributes);
+        writeGlobalArray(w, "varying ", varyings);
 
         if (!main->statements.empty()) {
-            os << "void main()\n";
-            main->write(os, 0);
+            w << "void main()\n";
+            main->write(w, 0);
         }
     }
 
 
+    /**
+     * Turns every IfCodeNode into a temporary, assigned in an if
+     * statement ahead of the statement that uses it.  One walk over
+     * the statements and their expressions finds them all, and each is
+     * replaced through its users, so this is linear in the size of the
+     * shader.
+     */
     void GLSLShader::splitBranches() {
-        // Conversion to StatementPtr overload is ambiguous otherwise.
-        StatementPtr main_stmt(main);
-
-        StatementPtr ref;
-        while (IfCodeNodePtr p = findBranch(main_stmt, ref)) {
-
-            CodeNodePtr condition = p->getChildren()[0];
-            CodeNodePtr truePart  = p->getChildren()[1];
-            CodeNodePtr falsePart = p->getChildren()[2];
-
-            string name = newRegisterName();
-
-            CodeNodePtr nameReference(
-                    new NameCodeNode(
-                        name,
-                        p->getType(),
-                        p->getFrequency(),
-                        NullValue,
-                        ValueNode::BUILTIN)); // suitable substitute for local
-
-            replace(main_stmt, p, nameReference);
-            
-            DeclarationPtr decl(new Declaration(p->getType(), name));
-
-            AssignmentPtr assignTrue(new Assignment);
-            assignTrue->define = false;
-            assignTrue->lhs = name;
-            assignTrue->rhs = truePart;
-
-            AssignmentPtr assignFalse(new Assignment);
-            assignFalse->define = false;
-            assignFalse->lhs = name;
-            assignFalse->rhs = falsePart;
-
-            IfStatementPtr ifst(new IfStatement);
-            ifst->condition = condition;
-            ifst->setTrue(assignTrue);
-            ifst->setFalse(assignFalse);
-
-            BlockPtr newBlock(new Block);
-            newBlock->statements.push_back(decl);
-            newBlock->statements.push_back(ifst);
-            newBlock->statements.push_back(ref);
-
-            if (main_stmt == ref) {
-                REN_DYNAMIC_CAST_PTR(main, Block, ref);
-                assert(main);
-                main_stmt = main;
-            } else {
-                replace(main_stmt, ref, newBlock);
+        CodeNodeSet visited;
+        StatementList& statements = main->statements;
+        for (size_t i = 0; i < statements.size(); ++i) {
+            splitBranches(&statements[i], visited);
+        }
+    }
+
+
+    /// Splits the branches in the statement in *slot, and in the
+    /// statements under it.
+    void GLSLShader::splitBranches(StatementPtr* slot, CodeNodeSet& visited) {
+        // Splitting moves the statement out of *slot, into a block.
+        StatementPtr statement = *slot;
+        if (CodeNodePtr e = statement->getExpression()) {
+            BlockPtr block;
+            splitBranches(e, slot, block, visited);
+        }
+
+        StatementList& children = statement->getChildren();
+        for (size_t i = 0; i < children.size(); ++i) {
+            splitBranches(&children[i], visited);
+        }
+    }
+
+
+    /**
+     * Splits the branches under node, which the statement in *slot
+     * reads.  The first one replaces the statement with a block that
+     * ends with it, and each one declares and assigns its temporary
+     * just ahead of it there.
+     */
+    void GLSLShader::splitBranches(
+        const CodeNodePtr& node,
+        StatementPtr* slot,
+        BlockPtr& block,
+        CodeNodeSet& visited
+    ) {
+        assert(node);
+
+        if (!visited.insert(node.get()).second) {
+            return;
+        }
+
+        if (node->getKind() != CodeNode::IF_CODE_NODE) {
+            // Splitting a child replaces it in the list, in place.
+            const CodeNodeList& children = node->getChildren();
+            for (size_t i = 0; i < children.size(); ++i) {
+                splitBranches(children[i], slot, block, visited);
             }
+            return;
+        }
+
+        // Held, since replacing its uses may release it.
+        CodeNodePtr p = node;
+        CodeNodePtr condition = p->getChildren()[0];
+        CodeNodePtr truePart  = p->getChildren()[1];
+        CodeNodePtr falsePart = p->getChildren()[2];
+
+        string name = newRegisterName();
+
+        CodeNodePtr nameReference(
+                new NameCodeNode(
+                    name,
+                    p->getType(),
+                    p->getFrequency(),
+                    NullValue,
+                    ValueNode::BUILTIN)); // suitable substitute for local
+
+        replaceUses(p, nameReference);
+
+        DeclarationPtr decl(new Declaration(p->getType(), name));
+
+        AssignmentPtr assignTrue(new Assignment);
+        assignTrue->define = false;
+        assignTrue->lhs = name;
+        assignTrue->setExpression(truePart);
+
+        AssignmentPtr assignFalse(new Assignment);
+        assignFalse->define = false;
+        assignFalse->lhs = name;
+        assignFalse->setExpression(falsePart);
+
+        IfStatementPtr ifst(new IfStatement);
+        ifst->setExpression(condition);
+        ifst->setTrue(assignTrue);
+        ifst->setFalse(assignFalse);
+
+        if (!block) {
+            block.reset(new Block);
+            block->statements.push_back(*slot);
+            *slot = block;
         }
+        StatementList& statements = block->statements;
+        statements.insert(statements.end() - 1, decl);
+        statements.insert(statements.end() - 1, ifst);
+
+        // The branch's own branches are split inside the if
+        // statement, so they're only computed when it's taken.
+        splitBranches(&statements[statements.size() - 2], visited);
     }
 
 
+    /**
+     * Computes every shared node into a register.  A node is shared
+     * if it would otherwise be written more than once.  Use counts come
+     * from one pass over the graph in topological order, registers are
+     * numbered in the order a depth-first walk of main reaches them,
+     * and each definition is placed before the first statement that
+     * needs it (or at the top of main, if several statements do).
+     */
     void GLSLShader::share() {
-        ReferenceMap rm;
-        countReferences(main, rm);
-
-//        std::cout << "++++\n";
-//        output(std::cout);
-
-        // Conversion to StatementPtr overload is ambiguous otherwise.
-        StatementPtr main_stmt(main);
-        while (CodeNodePtr p = findMultiplyReferenced(main_stmt, rm)) {
-            ReferenceList rl = rm[p];
-            ReferencePath prefix(getCommonPrefix(rl));
-            assert(prefix[0] == main);
-
-            string name = newRegisterName();
-
-            CodeNodePtr nameReference(
-                    new NameCodeNode(
-                        name,
-                        p->getType(),
-                        p->getFrequency(),
-                        NullValue,
-                        ValueNode::BUILTIN)); // suitable substitute for local
-
-            replace(main_stmt, p, nameReference);
-
-            AssignmentPtr ns(new Assignment);
-            ns->define = true;
-            ns->lhs = name;
-            ns->rhs = p;
-
-            assert(!prefix.empty());
-            StatementPtr lastInCommonPrefix(prefix[prefix.size() - 1]);
-
-            // Make a new block.
-            BlockPtr newBlock(new Block);
-            newBlock->statements.push_back(ns);
-            newBlock->statements.push_back(lastInCommonPrefix);
-
-            if (main_stmt == lastInCommonPrefix) {
-                main = newBlock;
-                main_stmt = main;
-            } else {
-                replace(main_stmt, lastInCommonPrefix, newBlock);
+        ShareMap info;
+
+        StatementList& top = main->statements;
+        std::vector<StatementList> roots(top.size());
+        CodeNodeList order;
+        for (size_t s = 0; s < top.size(); ++s) {
+            getExpressionStatements(top[s], roots[s]);
+            for (size_t r = 0; r < roots[s].size(); ++r) {
+                CodeNodePtr e = roots[s][r]->getExpression();
+                sortTopologically(e, info, order);
+                addUse(info[e.get()], 1, s);
+            }
+        }
+
+        // Users come before the nodes they use, so each node's count is
+        // final by the time it is reached.  A shared node is written
+        // once, no matter how many times it is used.
+        for (size_t n = order.size(); n--;) {
+            CodeNodePtr node = order[n];
+            ShareInfo& i = info[node.get()];
+            i.shared = (i.uses > 1 && canShare(node.get()));
+
+            unsigned count = (i.shared ? 1 : i.uses);
+            const CodeNodeList& children = node->getChildren();
+            for (size_t c = 0; c < children.size(); ++c) {
+                addUse(info[children[c].get()], count, i.statement);
             }
+        }
 
-            rm.clear();
-            countReferences(main, rm);
+        // Name registers in depth-first order.
+        CodeNodeList named;
+        for (size_t s = 0; s < roots.size(); ++s) {
+            for (size_t r = 0; r < roots[s].size(); ++r) {
+                CodeNodeList stack(1, roots[s][r]->getExpression());
+                while (!stack.empty()) {
+                    CodeNodePtr node = stack.back();
+                    stack.pop_back();
+
+                    ShareInfo& i = info[node.get()];
+                    if (i.named) {
+                        continue;
+                    }
+                    i.named = true;
+
+                    if (i.shared) {
+                        i.reference.reset(
+                            new NameCodeNode(
+                                newRegisterName(),
+                                node->getType(),
+                                node->getFrequency(),
+                                NullValue,
+                                ValueNode::BUILTIN)); // suitable substitute for local
+                        named.push_back(node);
+                    }
+
+                    const CodeNodeList& children = node->getChildren();
+                    for (size_t c = children.size(); c--;) {
+                        stack.push_back(children[c]);
+                    }
+                }
+            }
+        }
+
+        // Define registers ahead of their first use.
+        StatementList statements;
+        DefinitionWriter writer(info, statements);
+        for (size_t n = 0; n < named.size(); ++n) {
+            if (info[named[n].get()].statement == SEVERAL_STATEMENTS) {
+                writer.define(named[n]);
+            }
+        }
+        for (size_t s = 0; s < top.size(); ++s) {
+            for (size_t r = 0; r < roots[s].size(); ++r) {
+                writer.require(roots[s][r]->getExpression());
+            }
+            statements.push_back(top[s]);
+        }
 
-//            std::cout << "++++\n";
-//            output(std::cout);
+        // Finally, replace uses of shared nodes with their registers.
+        for (size_t n = 0; n < order.size(); ++n) {
+            // Not replaceUses: the definitions use these nodes too.
+            const CodeNodeList& children = order[n]->getChildren();
+            for (size_t c = 0; c < children.size(); ++c) {
+                ShareInfo& i = info[children[c].get()];
+                if (i.shared) {
+                    order[n]->setChild(c, i.reference);
+                }
+            }
         }
+        for (size_t s = 0; s < roots.size(); ++s) {
+            for (size_t r = 0; r < roots[s].size(); ++r) {
+                ShareInfo& i = info[roots[s][r]->getExpression().get()];
+                if (i.shared) {
+                    roots[s][r]->setExpression(i.reference);
+                }
+            }
+        }
+
+        top = statements;
     }
 
 
@@ -4,10 +4,13 @@
 
 #include <iostream>
 #include <map>
+#include <set>
 #include <vector>
 #include "Base.h"
 #include "CodeNode.h"
+#include "CompileStats.h"
 #include "GLSLStatement.h"
+#include "GLSLWriter.h"
 
 
 namespace ren {
@@ -17,7 +20,7 @@ namespace ren {
     typedef std::map<CodeNodePtr, ReferenceList> ReferenceMap;
 
     extern void countReferences(
-        CodeNodePtr node,
+        const CodeNodePtr& node,
         ReferenceMap& refs,
         const ReferencePath& path);
 
@@ -26,14 +29,17 @@ namespace ren {
         ReferenceMap& refs);
 
     extern CodeNodePtr findMultiplyReferenced(
-        CodeNodePtr node,
+        const CodeNodePtr& node,
         const ReferenceMap& refs);
 
-    extern CodeNodePtr findInterpolatable(CodeNodePtr node);
-    extern CodeNodePtr findInterpolatable(StatementPtr statement);
+    typedef std::map<CodeNodePtr, CodeNodePtr> CopyMap;
 
-    extern void replace(CodeNodePtr in, CodeNodePtr node, CodeNodePtr with);
-    extern void replace(StatementPtr st, CodeNodePtr node, CodeNodePtr with);
+    /**
+     * Copy a code graph, keeping shared nodes shared.  Every node is
+     * copied, names included, so that replacing uses in the copy
+     * leaves the original alone.
+     */
+    extern CodeNodePtr copy(CodeNodePtr node, CopyMap& copies);
 
 
     class GLSLShader {
@@ -58,14 +64,26 @@ namespace ren {
 
         GLSLShader();
 
-        void generate(std::ostream& os);
-        void output(std::ostream& os);
+        void generate(GLSLSink& sink, CompileStats* stats = 0);
+        void output(GLSLSink& sink);
 
         string newVaryingName();
 
+        /// Temporaries introduced by sharing so far.
+        unsigned getRegisterCount() const {
+            return _register;
+        }
+
     private:
         string newRegisterName();
+
         void splitBranches();
+        void splitBranches(StatementPtr* slot, std::set<CodeNode*>& visited);
+        void splitBranches(const CodeNodePtr& node,
+                           StatementPtr* slot,
+                           BlockPtr& block,
+                           std::set<CodeNode*>& visited);
+
         void share();
 
         unsigned _varying;
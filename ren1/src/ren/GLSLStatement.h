@@ -2,17 +2,17 @@
 #define GLSL_STATEMENT_H
 
 
-#include <iostream>
 #include "CodeNode.h"
+#include "GLSLWriter.h"
 
 
 namespace ren {
 
-    inline std::ostream& beginline(std::ostream& os, int amount) {
+    inline GLSLWriter& beginline(GLSLWriter& w, int amount) {
         while (amount--) {
-            os << "  ";
+            w << "  ";
         }
-        return os;
+        return w;
     }
 
 
@@ -21,30 +21,73 @@ namespace ren {
     typedef std::vector<StatementPtr> StatementList;
     
 
-    struct Statement {
+    struct Statement : public CodeNodeUser, public ArenaObject {
+        /// Which subclass this is, for switches and REN_KIND_CAST.
+        enum Kind {
+            IF_STATEMENT,
+            DECLARATION,
+            ASSIGNMENT,
+            BLOCK,
+        };
+
+        Statement(Kind kind)
+        : _kind(kind) {
+        }
+
         // Shut up gcc.
         virtual ~Statement() { }
 
+        Kind getKind() const {
+            return _kind;
+        }
+
         virtual CodeNodePtr getExpression() const = 0;
         virtual void setExpression(CodeNodePtr node) = 0;
 
         virtual StatementList& getChildren() = 0;
 
-        virtual void write(std::ostream& os, int indent) const = 0;
+        virtual void write(GLSLWriter& w, int indent) const = 0;
+
+        void replaceUse(CodeNode* node, CodeNodePtr with) {
+            assert(getExpression().get() == node);
+            setExpression(with);
+        }
+
+    protected:
+        /// Point an expression at node and register as its user.
+        void setUse(CodeNodePtr& expression, CodeNodePtr node) {
+            if (expression) {
+                expression->removeUser(this);
+            }
+            expression = node;
+            if (expression) {
+                expression->addUser(this);
+            }
+        }
+
+    private:
+        Kind _kind;
     };
 
 
     struct IfStatement : public Statement {
+        static const Kind KIND = IF_STATEMENT;
+
         IfStatement()
-        : children(2) {
+        : Statement(KIND)
+        , children(2) {
+        }
+
+        ~IfStatement() {
+            setUse(_condition, CodeNodePtr());
         }
 
         CodeNodePtr getExpression() const {
-            return condition;
+            return _condition;
         }
 
         void setExpression(CodeNodePtr node) {
-            condition = node;
+            setUse(_condition, node);
         }
 
         void setTrue(StatementPtr st) {
@@ -62,24 +105,31 @@ namespace ren {
             return children;
         }
 
-        void write(std::ostream& os, int indent) const {
+        void write(GLSLWriter& w, int indent) const {
             assert(children.size() == 2);
 
-            beginline(os, indent) << "if (" << condition->asExpression() << ")\n";
-            children[0]->write(os, indent + 1);
-            beginline(os, indent) << "else\n";
-            children[1]->write(os, indent + 1);
+            beginline(w, indent) << "if (";
+            _condition->writeExpression(w);
+            w << ")\n";
+            children[0]->write(w, indent + 1);
+            beginline(w, indent) << "else\n";
+            children[1]->write(w, indent + 1);
         }
 
-        CodeNodePtr condition;
         StatementList children;
+
+    private:
+        CodeNodePtr _condition;
     };
     REN_SHARED_PTR(IfStatement);
 
 
     struct Declaration : public Statement {
+        static const Kind KIND = DECLARATION;
+
         Declaration(Type type_, const string& name_)
-        : type(type_)
+        : Statement(KIND)
+        , type(type_)
         , name(name_) {
         }
 
@@ -95,8 +145,8 @@ namespace ren {
             return children;
         }
 
-        void write(std::ostream& os, int indent) const {
-            beginline(os, indent) << type << " " << name << ";\n";
+        void write(GLSLWriter& w, int indent) const {
+            beginline(w, indent) << type << " " << name << ";\n";
         }
 
         Type type;
@@ -109,37 +159,55 @@ namespace ren {
 
 
     struct Assignment : public Statement {
+        static const Kind KIND = ASSIGNMENT;
+
+        Assignment()
+        : Statement(KIND) {
+        }
+
+        ~Assignment() {
+            setUse(_rhs, CodeNodePtr());
+        }
+
         CodeNodePtr getExpression() const {
-            return rhs;
+            return _rhs;
         }
 
         void setExpression(CodeNodePtr node) {
-            rhs = node;
+            setUse(_rhs, node);
         }
 
         StatementList& getChildren() {
             return children;
         }
 
-        void write(std::ostream& os, int indent) const {
-            beginline(os, indent);
+        void write(GLSLWriter& w, int indent) const {
+            beginline(w, indent);
             if (define) {
-                os << rhs->getType() << " ";
+                w << _rhs->getType() << " ";
             }
-            os << lhs << " = " << rhs->asExpression() << ";\n";
+            w << lhs << " = ";
+            _rhs->writeExpression(w);
+            w << ";\n";
         }
 
         bool define;
         string lhs;
-        CodeNodePtr rhs;
 
     private:
+        CodeNodePtr _rhs;
         StatementList children;
     };
     REN_SHARED_PTR(Assignment);
 
 
     struct Block : public Statement {
+        static const Kind KIND = BLOCK;
+
+        Block()
+        : Statement(KIND) {
+        }
+
         CodeNodePtr getExpression() const {
             return CodeNodePtr();
         }
@@ -152,12 +220,12 @@ namespace ren {
             return statements;
         }
 
-        void write(std::ostream& os, int indent) const {
-            beginline(os, indent) << "{\n";
+        void write(GLSLWriter& w, int indent) const {
+            beginline(w, indent) << "{\n";
             for (size_t i = 0; i < statements.size(); ++i) {
-                statements[i]->write(os, indent + 1);
+                statements[i]->write(w, indent + 1);
             }
-            beginline(os, indent) << "}\n";
+            beginline(w, indent) << "}\n";
         }
 
         StatementList statements;
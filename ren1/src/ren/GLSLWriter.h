@@ -0,0 +1,120 @@
+#ifndef REN_GLSL_WRITER_H
+#define REN_GLSL_WRITER_H
+
+
+#include <cstring>
+#include <iostream>
+#include <boost/noncopyable.hpp>
+#include "Types.h"
+
+
+namespace ren {
+
+    /// Where generated GLSL ends up.
+    class GLSLSink {
+    public:
+        virtual void append(const char* data, size_t size) = 0;
+
+    protected:
+        ~GLSLSink() { }
+    };
+
+
+    /// Appends to a string the caller owns.
+    class StringSink : public GLSLSink {
+    public:
+        StringSink(string& text)
+        : _text(text) {
+        }
+
+        void append(const char* data, size_t size) {
+            _text.append(data, size);
+        }
+
+    private:
+        string& _text;
+    };
+
+
+    class StreamSink : public GLSLSink {
+    public:
+        StreamSink(std::ostream& os)
+        : _os(os) {
+        }
+
+        void append(const char* data, size_t size) {
+            _os.write(data, size);
+        }
+
+    private:
+        std::ostream& _os;
+    };
+
+
+    /**
+     * Collects generated text and hands it to a sink in large pieces.
+     * Expressions write themselves straight into it, so nested
+     * expressions are never copied into temporary strings.
+     */
+    class GLSLWriter : public boost::noncopyable {
+    public:
+        GLSLWriter(GLSLSink& sink)
+        : _sink(sink)
+        , _size(0) {
+        }
+
+        ~GLSLWriter() {
+            flush();
+        }
+
+        void write(const char* data, size_t size) {
+            if (_size + size > BUFFER_SIZE) {
+                flush();
+                if (size > BUFFER_SIZE) {
+                    _sink.append(data, size);
+                    return;
+                }
+            }
+            memcpy(_buffer + _size, data, size);
+            _size += size;
+        }
+
+        /// Pass everything written so far to the sink.
+        void flush() {
+            if (_size) {
+                _sink.append(_buffer, _size);
+                _size = 0;
+            }
+        }
+
+        GLSLWriter& operator<<(const char* s) {
+            write(s, strlen(s));
+            return *this;
+        }
+
+        GLSLWriter& operator<<(const string& s) {
+            write(s.data(), s.size());
+            return *this;
+        }
+
+        GLSLWriter& operator<<(char c) {
+            write(&c, 1);
+            return *this;
+        }
+
+        GLSLWriter& operator<<(Type type) {
+            return *this << type.getName();
+        }
+
+    private:
+        enum { BUFFER_SIZE = 4096 };
+
+        GLSLSink& _sink;
+        size_t _size;
+        char _buffer[BUFFER_SIZE];
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,63 @@
+#include <cstring>
+#include "PermutationKey.h"
+
+
+namespace ren {
+
+    static const size_t WORD_BITS = 32;
+
+
+    size_t PermutationKey::add(Type type) {
+        size_t count = getArity(type);
+        size_t offset;
+        if (getElementType(type) == BOOL) {
+            offset = _bits;
+            _bits += count;
+        } else {
+            offset = (_bits + WORD_BITS - 1) / WORD_BITS * WORD_BITS;
+            _bits = offset + count * WORD_BITS;
+        }
+
+        _words.resize((_bits + WORD_BITS - 1) / WORD_BITS);
+        rehash();
+        return offset;
+    }
+
+
+    void PermutationKey::set(size_t offset, Type type, const Value& v) {
+        size_t count = getArity(type);
+        Type elementType = getElementType(type);
+        if (elementType == BOOL) {
+            for (size_t i = 0; i < count; ++i) {
+                size_t bit = offset + i;
+                boost::uint32_t mask = boost::uint32_t(1) << (bit % WORD_BITS);
+                if (v.asBoolVec()[i]) {
+                    _words[bit / WORD_BITS] |= mask;
+                } else {
+                    _words[bit / WORD_BITS] &= ~mask;
+                }
+            }
+        } else {
+            // Floats are compared by their bits, so 0.0 and -0.0 are
+            // different keys.  That only costs an extra compile.
+            const void* data = (elementType == FLOAT
+                                ? static_cast<const void*>(v.asFloatVec())
+                                : static_cast<const void*>(v.asIntVec()));
+            memcpy(&_words[offset / WORD_BITS], data,
+                   count * sizeof(boost::uint32_t));
+        }
+        rehash();
+    }
+
+
+    void PermutationKey::rehash() {
+        // FNV-1a, a word at a time.
+        boost::uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < _words.size(); ++i) {
+            hash ^= _words[i];
+            hash *= 16777619u;
+        }
+        _hash = hash;
+    }
+
+}
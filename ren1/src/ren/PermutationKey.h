@@ -0,0 +1,73 @@
+#ifndef REN_PERMUTATION_KEY_H
+#define REN_PERMUTATION_KEY_H
+
+
+#include <vector>
+#include <boost/cstdint.hpp>
+#include "Types.h"
+#include "Value.h"
+
+
+namespace ren {
+
+    /**
+     * Identifies a program's constant values, and so the shaders
+     * compiled for them.  Program updates its key whenever a constant
+     * is set, so comparing or hashing keys never looks at the values
+     * themselves.  Each bool takes a bit; every other component takes
+     * its 32 bits, so two keys are equal only if the values are
+     * identical.
+     */
+    class PermutationKey {
+    public:
+        PermutationKey()
+        : _bits(0)
+        , _hash(0) {
+        }
+
+        size_t getHash() const {
+            return _hash;
+        }
+
+        bool operator==(const PermutationKey& rhs) const {
+            return _hash == rhs._hash && _words == rhs._words;
+        }
+
+        bool operator!=(const PermutationKey& rhs) const {
+            return !(*this == rhs);
+        }
+
+        /// Orders by hash first, so most comparisons are one compare.
+        bool operator<(const PermutationKey& rhs) const {
+            if (_hash != rhs._hash) {
+                return _hash < rhs._hash;
+            }
+            return _words < rhs._words;
+        }
+
+    private:
+        friend class Program;
+
+        /// Makes room for a zeroed value of the given type, and
+        /// returns the bit it starts at.
+        size_t add(Type type);
+
+        void set(size_t offset, Type type, const Value& v);
+
+        void rehash();
+
+        std::vector<boost::uint32_t> _words;
+        size_t _bits;
+        size_t _hash;
+    };
+
+
+    /// For boost::hash, and so boost::unordered_map.
+    inline size_t hash_value(const PermutationKey& key) {
+        return key.getHash();
+    }
+
+}
+
+
+#endif
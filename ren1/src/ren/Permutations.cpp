@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <sstream>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include "Permutations.h"
+
+
+namespace ren {
+
+    namespace {
+
+        /**
+         * The permutations left to compile.  Each worker takes the
+         * next one as soon as it finishes its last, so a thread that
+         * draws cheap permutations keeps going while another is stuck
+         * on an expensive one.
+         */
+        class Job : public boost::noncopyable {
+        public:
+            Job(ProgramPtr program,
+                const ConstantMapList& permutations,
+                const CompileOptions& options)
+            : _program(program)
+            , _permutations(permutations)
+            , _options(options)
+            , _next(0)
+            , _results(permutations.size(), CompileResult(false))
+            , _outputs(permutations.size()) {
+            }
+
+            void run() {
+                size_t i = 0;
+                while (take(i)) {
+                    std::ostringstream output;
+                    _results[i] = compile(_permutations[i], output);
+                    _outputs[i] = output.str();
+                }
+            }
+
+            const std::vector<CompileResult>& getResults() const {
+                return _results;
+            }
+
+            const std::vector<string>& getOutputs() const {
+                return _outputs;
+            }
+
+        private:
+            bool take(size_t& i) {
+                boost::mutex::scoped_lock lock(_mutex);
+                if (_next == _permutations.size()) {
+                    return false;
+                }
+                i = _next++;
+                return true;
+            }
+
+            CompileResult compile(
+                const ConstantMap& constants,
+                std::ostream& output
+            ) {
+                CompileOptions options(_options);
+                options.constants = constants;
+                options.constants.insert(
+                    _options.constants.begin(), _options.constants.end());
+                return ren::compile(_program, options, output);
+            }
+
+            ProgramPtr _program;
+            const ConstantMapList& _permutations;
+            CompileOptions _options;
+
+            boost::mutex _mutex;
+            size_t _next;
+
+            // Each element is written by the one thread that took it.
+            std::vector<CompileResult> _results;
+            std::vector<string> _outputs;
+        };
+
+    }
+
+
+    ConstantMapList getBoolPermutations(const std::vector<string>& names) {
+        ConstantMapList rv;
+        for (size_t p = 0; p < (size_t(1) << names.size()); ++p) {
+            ConstantMap constants;
+            for (size_t i = 0; i < names.size(); ++i) {
+                bool value = (p >> i) & 1;
+                constants[names[i]] = Value::create(BOOL, &value);
+            }
+            rv.push_back(constants);
+        }
+        return rv;
+    }
+
+
+    std::vector<CompileResult> compilePermutations(
+        ProgramPtr program,
+        const ConstantMapList& permutations,
+        const CompileOptions& options,
+        unsigned threads,
+        std::ostream& output
+    ) {
+        if (threads == 0) {
+            threads = std::max(1u, boost::thread::hardware_concurrency());
+        }
+        threads = std::min<size_t>(threads, permutations.size());
+
+        Job job(program, permutations, options);
+        if (threads <= 1) {
+            job.run();
+        } else {
+            boost::thread_group workers;
+            for (unsigned i = 0; i < threads; ++i) {
+                workers.create_thread(boost::bind(&Job::run, &job));
+            }
+            workers.join_all();
+        }
+
+        const std::vector<string>& outputs = job.getOutputs();
+        for (size_t i = 0; i < outputs.size(); ++i) {
+            output << outputs[i];
+        }
+        return job.getResults();
+    }
+
+}
@@ -0,0 +1,38 @@
+#ifndef REN_PERMUTATIONS_H
+#define REN_PERMUTATIONS_H
+
+
+#include <iostream>
+#include <vector>
+#include "Compiler.h"
+#include "Program.h"
+
+
+namespace ren {
+
+    typedef std::vector<ConstantMap> ConstantMapList;
+
+    /// Every combination of values of the given bool constants.  The
+    /// first name alternates fastest.
+    ConstantMapList getBoolPermutations(const std::vector<string>& names);
+
+    /**
+     * Compiles program once for each set of constant values, up to
+     * threads at a time.  0 threads means one per core.  The parsed
+     * program is shared, and isn't changed: each compile's constants
+     * override the program's, and the options', values.
+     *
+     * Results are in the order of permutations, and so is what each
+     * compile writes to output.
+     */
+    std::vector<CompileResult> compilePermutations(
+        ProgramPtr program,
+        const ConstantMapList& permutations,
+        const CompileOptions& options = CompileOptions(),
+        unsigned threads = 0,
+        std::ostream& output = std::cerr);
+
+}
+
+
+#endif
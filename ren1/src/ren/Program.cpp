@@ -5,19 +5,22 @@
 
 namespace ren {
 
+    const size_t Program::NOT_PACKED;
+
+
     void Program::print() {
         for (size_t i = 0; i < _uniforms.size(); ++i) {
             std::cout << "Uniform: " << _uniforms[i].getType()
                       << " " << _uniforms[i].getName() << std::endl;
         }
 
-        for (size_t i = 0; i < attributes.size(); ++i) {
-            std::cout << "Attribute: " << attributes[i].getType()
-                      << " " << attributes[i].getName() << std::endl;
+        for (size_t i = 0; i < _attributes.size(); ++i) {
+            std::cout << "Attribute: " << _attributes[i].getType()
+                      << " " << _attributes[i].getName() << std::endl;
         }
 
-        for (size_t i = 0; i < definitions.size(); ++i) {
-            definitions[i]->print();
+        for (size_t i = 0; i < _definitions.size(); ++i) {
+            _definitions[i]->print();
         }
     }
 
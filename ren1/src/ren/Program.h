@@ -7,7 +7,9 @@
 #include <vector>
 #include <boost/shared_ptr.hpp>
 #include "Definition.h"
+#include "PermutationKey.h"
 #include "Types.h"
+#include "UniformLayout.h"
 #include "Value.h"
 
 
@@ -34,6 +36,10 @@ namespace ren {
     };
 
 
+    /// Values for some of a program's constants, by name.
+    typedef std::map<string, ValuePtr> ConstantMap;
+
+
     class Program {
     public:
         typedef std::vector<Input> InputList;
@@ -44,19 +50,41 @@ namespace ren {
         // Static Program data.
 
         void addConstant(const Input& c) {
-            _constants.push_back(c);
+            addInput(c, _constants, _constantIndices);
 
             size_t index = _constantValues.size();
             _constantValues.push_back(Value::create(c.getType()));
             _constantValueIndices[c.getName()] = index;
+            _constantKeyOffsets.push_back(_permutationKey.add(c.getType()));
         }
 
         void addUniform(const Input& u) {
-            _uniforms.push_back(u);
+            addInput(u, _uniforms, _uniformIndices);
 
             size_t index = _uniformValues.size();
             _uniformValues.push_back(Value::create(u.getType()));
             _uniformValueIndices[u.getName()] = index;
+
+            // The buffer starts out zeroed, like the values.
+            if (_uniformLayout.add(u.getName(), u.getType())) {
+                _uniformEntries.push_back(
+                    _uniformLayout.getEntries().size() - 1);
+                _uniformBuffer.resize(_uniformLayout.getSize());
+            } else {
+                _uniformEntries.push_back(NOT_PACKED);
+            }
+        }
+
+        void addAttribute(const Input& a) {
+            addInput(a, _attributes, _attributeIndices);
+        }
+
+        void addDefinition(DefinitionPtr d) {
+            // Like the other indices, the first definition wins.
+            _definitionIndices.insert(DefinitionIndexMap::value_type(
+                DefinitionKey(d->name, d->arguments.size()),
+                _definitions.size()));
+            _definitions.push_back(d);
         }
 
         const InputList& getConstants() const {
@@ -67,30 +95,36 @@ namespace ren {
             return _uniforms;
         }
 
+        const InputList& getAttributes() const {
+            return _attributes;
+        }
+
+        const std::vector<DefinitionPtr>& getDefinitions() const {
+            return _definitions;
+        }
+
         const Input* getConstant(const string& name) const {
-            return getInput(name, _constants);
+            return getInput(name, _constants, _constantIndices);
         }
 
         const Input* getUniform(const string& name) const {
-            return getInput(name, _uniforms);
+            return getInput(name, _uniforms, _uniformIndices);
         }
 
         const Input* getAttribute(const string& name) const {
-            return getInput(name, attributes);
+            return getInput(name, _attributes, _attributeIndices);
         }
 
         DefinitionPtr getDefinition(
             const string& name,
             size_t args = 0
         ) const {
-            for (size_t i = 0; i < definitions.size(); ++i) {
-                if (definitions[i]->name == name &&
-                    definitions[i]->arguments.size() == args
-                ) {
-                    return definitions[i];
-                }
+            DefinitionIndexMap::const_iterator i = _definitionIndices.find(
+                DefinitionKey(name, args));
+            if (i == _definitionIndices.end()) {
+                return DefinitionPtr();
             }
-            return DefinitionPtr();
+            return _definitions[i->second];
         }
 
         bool hasDefinition(const string& name) const {
@@ -99,66 +133,151 @@ namespace ren {
 
         // Program Value data.
 
-        ValuePtr getConstantValue(const string& name) {
-            size_t index = _constantValueIndices[name];
-            assert(index < _constantValues.size());
-            return _constantValues[index];
+        ValuePtr getConstantValue(const string& name) const {
+            ValueIndexMap::const_iterator i = _constantValueIndices.find(name);
+            assert(i != _constantValueIndices.end());
+            return _constantValues[i->second];
         }
 
         void setConstantValue(const string& name, ValuePtr v) {
             size_t index = _constantValueIndices[name];
             assert(index < _constantValues.size());
             _constantValues[index] = v;
+            _permutationKey.set(
+                _constantKeyOffsets[index], _constants[index].getType(), *v);
         }
 
         const ValueList& getConstantValues() const {
             return _constantValues;
         }
 
-        ValuePtr getUniformValue(const string& name) {
-            size_t index = _uniformValueIndices[name];
-            assert(index < _uniformValues.size());
-            return _uniformValues[index];
+        /// Throws std::runtime_error if the program lacks one of the
+        /// constants or its type differs.
+        void checkConstantValues(const ConstantMap& constants) const {
+            ConstantMap::const_iterator i = constants.begin();
+            for (; i != constants.end(); ++i) {
+                const Input* c = getConstant(i->first);
+                if (!c || c->getType() != i->second->getType()) {
+                    throw std::runtime_error(
+                        "Program has no constant " + i->first +
+                        " of type " + i->second->getType().getName());
+                }
+            }
+        }
+
+        /// Checks the values, as above, before setting any.
+        void setConstantValues(const ConstantMap& constants) {
+            checkConstantValues(constants);
+            ConstantMap::const_iterator i = constants.begin();
+            for (; i != constants.end(); ++i) {
+                setConstantValue(i->first, i->second);
+            }
+        }
+
+        /// Identifies the current constant values.  Cheaper to compare
+        /// than getConstantValues(), and kept up to date as they're
+        /// set.
+        const PermutationKey& getPermutationKey() const {
+            return _permutationKey;
+        }
+
+        ValuePtr getUniformValue(const string& name) const {
+            ValueIndexMap::const_iterator i = _uniformValueIndices.find(name);
+            assert(i != _uniformValueIndices.end());
+            return _uniformValues[i->second];
         }
 
         void setUniformValue(const string& name, ValuePtr v) {
             size_t index = _uniformValueIndices[name];
             assert(index < _uniformValues.size());
             _uniformValues[index] = v;
+
+            size_t entry = _uniformEntries[index];
+            if (entry != NOT_PACKED) {
+                UniformLayout::write(
+                    &_uniformBuffer[0],
+                    _uniformLayout.getEntries()[entry],
+                    *v);
+            }
         }
 
         const ValueList& getUniformValues() const {
             return _uniformValues;
         }
 
-        // Public properties.
+        /// Where the uniforms are in getUniformBuffer(), and in the
+        /// shaders when they're compiled with packUniforms.
+        const UniformLayout& getUniformLayout() const {
+            return _uniformLayout;
+        }
 
-        InputList attributes;
-        std::vector<DefinitionPtr> definitions;
+        /// Every packable uniform's value, as laid out by
+        /// getUniformLayout().  Setting a uniform updates it, so it's
+        /// always ready to upload in one call.
+        const float* getUniformBuffer() const {
+            return _uniformBuffer.empty() ? 0 : &_uniformBuffer[0];
+        }
 
     private:
+        /// Indices into an InputList by name.
+        typedef std::map<string, size_t> InputIndexMap;
+
+        static void addInput(
+            const Input& input,
+            InputList& inputs,
+            InputIndexMap& indices
+        ) {
+            // insert() keeps the first input with a name, which is the
+            // one a scan of the list would find.
+            indices.insert(InputIndexMap::value_type(
+                               input.getName(), inputs.size()));
+            inputs.push_back(input);
+        }
+
         static const Input* getInput(
             const string& name,
-            const InputList& inputs
+            const InputList& inputs,
+            const InputIndexMap& indices
         ) {
-            for (size_t i = 0; i < inputs.size(); ++i) {
-                if (inputs[i].getName() == name) {
-                    return &inputs[i];
-                }
+            InputIndexMap::const_iterator i = indices.find(name);
+            if (i == indices.end()) {
+                return 0;
             }
-            return 0;
+            return &inputs[i->second];
         }
 
-        InputList _constants;
-        InputList _uniforms;
+        InputList     _constants;
+        InputIndexMap _constantIndices;
+
+        InputList     _uniforms;
+        InputIndexMap _uniformIndices;
+
+        InputList     _attributes;
+        InputIndexMap _attributeIndices;
+
+        /// Definitions are found by name and number of arguments.
+        typedef std::pair<string, size_t> DefinitionKey;
+        typedef std::map<DefinitionKey, size_t> DefinitionIndexMap;
+
+        std::vector<DefinitionPtr> _definitions;
+        DefinitionIndexMap         _definitionIndices;
 
         typedef std::map<string, size_t> ValueIndexMap;
 
         ValueIndexMap _constantValueIndices;
         ValueList     _constantValues;
 
+        PermutationKey      _permutationKey;
+        std::vector<size_t> _constantKeyOffsets;  ///< By value index.
+
         ValueIndexMap _uniformValueIndices;
         ValueList     _uniformValues;
+
+        static const size_t NOT_PACKED = size_t(-1);
+
+        UniformLayout       _uniformLayout;
+        std::vector<float>  _uniformBuffer;
+        std::vector<size_t> _uniformEntries;  ///< By value index.
     };
     typedef boost::shared_ptr<Program> ProgramPtr;
 
@@ -51,13 +51,17 @@ namespace ren {
     ConcreteNodePtr ProgramScope::lookup(const string& name, Type argTypes) {
         Signature sig(name, argTypes);
 
-        if (_recursionCheck[sig]) {
+        RecursionCheck::iterator r = _recursionCheck.find(sig);
+        if (r != _recursionCheck.end() && r->second) {
             throw CompileError("Recursion not allowed in definition of " +
                                name);
         }
 
-        if (_lookupCache[sig]) {
-            return _lookupCache[sig];
+        // find(), not [], so built-in names don't fill the cache with
+        // empty entries.
+        LookupCache::iterator i = _lookupCache.find(sig);
+        if (i != _lookupCache.end()) {
+            return i->second;
         }
 
         RecursionGuard guard__(sig, *this);
@@ -69,12 +73,15 @@ namespace ren {
 
             // Is it a constant?
             if (const Input* c = _program->getConstant(name)) {
+                ConstantMap::const_iterator i = _constants.find(name);
                 return cache(sig, ConcreteNodePtr(
                     new ValueNode(
                         name,
                         c->getType(),
                         CONSTANT,
-                        _program->getConstantValue(name),
+                        (i == _constants.end()
+                         ? _program->getConstantValue(name)
+                         : i->second),
                         ValueNode::CONSTANT)));
             }
 
@@ -17,15 +17,19 @@ namespace ren {
         : public Scope
         , public boost::enable_shared_from_this<ProgramScope> {
     private:
-        ProgramScope(ProgramPtr program)
-        : _program(program) {
+        ProgramScope(ProgramPtr program, const ConstantMap& constants)
+        : _program(program)
+        , _constants(constants) {
         }
 
     public:
         typedef boost::shared_ptr<ProgramScope> Ptr;
 
-        static Ptr create(ProgramPtr program) {
-            return Ptr(new ProgramScope(program));
+        static Ptr create(
+            ProgramPtr program,
+            const ConstantMap& constants = ConstantMap()
+        ) {
+            return Ptr(new ProgramScope(program, constants));
         }
 
         ConcreteNodePtr lookup(const string& name, Type argTypes);
@@ -41,6 +45,10 @@ namespace ren {
 
         ProgramPtr _program;
 
+        /// Override the program's constant values, which the scope
+        /// only reads.
+        ConstantMap _constants;
+
         typedef std::map<Signature, bool> RecursionCheck;
         RecursionCheck _recursionCheck;
 
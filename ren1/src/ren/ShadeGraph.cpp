@@ -1,5 +1,10 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <set>
+#include <sstream>
+#include "Errors.h"
 #include "ShadeGraph.h"
 
 
@@ -8,92 +13,915 @@ namespace {
 
     typedef std::set<NameCodeNodePtr> NameCodeNodeSet;
 
+    typedef std::set<CodeNode*> CodeNodeSet;
+
+    // These walks skip nodes they've already seen, so shared
+    // subexpressions aren't searched once per path.
+
     void getReferencesOfType(
         NameCodeNodeSet& result,
-        CodeNodePtr codeNode,
-        ValueNode::InputType type
+        const CodeNodePtr& codeNode,
+        ValueNode::InputType type,
+        CodeNodeSet& visited
     ) {
         assert(codeNode);
-        if (REN_DYNAMIC_CAST_PTR(p, CallCodeNode, codeNode)) {
-            CodeNodeList args = p->getChildren();
-            for (size_t i = 0; i < args.size(); ++i) {
-                getReferencesOfType(result, args[i], type);
-            }
-        } else if (REN_DYNAMIC_CAST_PTR(p, IfCodeNode, codeNode)) {
-            CodeNodeList args = p->getChildren();
-            for (size_t i = 0; i < args.size(); ++i) {
-                getReferencesOfType(result, args[i], type);
+        if (!visited.insert(codeNode.get()).second) {
+            return;
+        }
+
+        switch (codeNode->getKind()) {
+            case CodeNode::CALL_CODE_NODE:
+            case CodeNode::IF_CODE_NODE: {
+                const CodeNodeList& args = codeNode->getChildren();
+                for (size_t i = 0; i < args.size(); ++i) {
+                    getReferencesOfType(result, args[i], type, visited);
+                }
+                break;
             }
-        } else if (REN_DYNAMIC_CAST_PTR(p, NameCodeNode, codeNode)) {
-            if (p->getInputType() == type) {
-                result.insert(p);
+
+            case CodeNode::NAME_CODE_NODE: {
+                NameCodeNode* p = static_cast<NameCodeNode*>(codeNode.get());
+                if (p->getInputType() == type) {
+                    result.insert(boost::static_pointer_cast<NameCodeNode>(
+                                      codeNode));
+                }
+                break;
             }
-        } else {
-            assert(!"Unknown Code Node");
+
+            default:
+                assert(!"Unknown Code Node");
         }
     }
 
     void getReferencesOfType(
         NameCodeNodeSet& result,
         StatementPtr statement,
-        ValueNode::InputType type
+        ValueNode::InputType type,
+        CodeNodeSet& visited
     ) {
         if (CodeNodePtr cn = statement->getExpression()) {
-            getReferencesOfType(result, cn, type);
+            getReferencesOfType(result, cn, type, visited);
         }
         const StatementList& children = statement->getChildren();
         for (size_t i = 0; i < children.size(); ++i) {
-            getReferencesOfType(result, children[i], type);
+            getReferencesOfType(result, children[i], type, visited);
+        }
+    }
+
+    void getReferencesOfType(
+        NameCodeNodeSet& result,
+        StatementPtr statement,
+        ValueNode::InputType type
+    ) {
+        CodeNodeSet visited;
+        getReferencesOfType(result, statement, type, visited);
+    }
+
+    /// The value of a constant node, or null if it isn't one.
+    ValuePtr getConstantValue(const CodeNodePtr& node) {
+        if (REN_KIND_CAST(n, NameCodeNode, node.get())) {
+            if (n->getFrequency() == CONSTANT) {
+                return n->getValue();
+            }
+        }
+        return ValuePtr();
+    }
+
+    /// Is node a constant with every component equal to x?
+    bool isConstant(const CodeNodePtr& node, float x) {
+        ValuePtr value = getConstantValue(node);
+        if (!value) {
+            return false;
+        }
+
+        Type elementType = getElementType(node->getType());
+        int arity = getArity(node->getType());
+        for (int i = 0; i < arity; ++i) {
+            if (elementType == FLOAT) {
+                if (value->asFloatVec()[i] != x) return false;
+            } else if (elementType == INT) {
+                if (value->asIntVec()[i] != x) return false;
+            } else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// The shortest text that reads back as f, or "" if there's none.
+    string formatFloat(float f) {
+        if (!(f - f == 0)) {
+            // Infinity and NaN have no literals.
+            return "";
+        }
+
+        char buf[32];
+        for (int precision = 1; precision <= 9; ++precision) {
+            sprintf(buf, "%.*g", precision, f);
+            if (float(strtod(buf, 0)) == f) {
+                break;
+            }
+        }
+
+        string rv(buf);
+        if (rv.find_first_of(".e") == string::npos) {
+            rv += ".0";
+        }
+        return rv;
+    }
+
+    /// GLSL for value, or "" if it can't be written.
+    string formatLiteral(ValuePtr value, Type type) {
+        Type elementType = getElementType(type);
+        int arity = getArity(type);
+
+        std::vector<string> components;
+        for (int i = 0; i < arity; ++i) {
+            std::ostringstream os;
+            if (elementType == FLOAT) {
+                os << formatFloat(value->asFloatVec()[i]);
+            } else if (elementType == INT) {
+                os << value->asIntVec()[i];
+            } else {
+                os << (value->asBoolVec()[i] ? "true" : "false");
+            }
+            if (os.str().empty()) {
+                return "";
+            }
+            components.push_back(os.str());
+        }
+
+        if (arity == 1) {
+            return components[0];
+        }
+
+        string rv = type.getName() + "(";
+        for (int i = 0; i < arity; ++i) {
+            if (i != 0) {
+                rv += ", ";
+            }
+            rv += components[i];
+        }
+        return rv + ")";
+    }
+
+    /**
+     * Folds and simplifies expressions.  Literals it creates are
+     * shared, so equal results are the same node.
+     */
+    class Simplifier {
+    public:
+        /// Returns what should replace node.
+        CodeNodePtr simplify(CodeNodePtr node) {
+            if (!_visited.insert(node.get()).second) {
+                return node;
+            }
+
+            // Children are replaced for all of their users at once, so
+            // the ones we've visited never show up again.
+            for (size_t i = 0; i < node->getChildren().size(); ++i) {
+                CodeNodePtr child = node->getChildren()[i];
+                CodeNodePtr with = simplify(child);
+                if (with != child) {
+                    replaceUses(child, with);
+                }
+            }
+
+            while (CodeNodePtr with = rewrite(node)) {
+                node = with;
+                _visited.insert(node.get());
+            }
+            return node;
+        }
+
+    private:
+        /// A simpler equivalent of node, or null.
+        CodeNodePtr rewrite(const CodeNodePtr& node) {
+            const CodeNodeList& args = node->getChildren();
+
+            if (node->getKind() == CodeNode::IF_CODE_NODE) {
+                if (ValuePtr condition = getConstantValue(args[0])) {
+                    return condition->asBool() ? args[1] : args[2];
+                }
+                if (args[1] == args[2]) {
+                    return args[1];
+                }
+                return CodeNodePtr();
+            }
+
+            REN_KIND_CAST(call, CallCodeNode, node.get());
+            if (!call) {
+                return CodeNodePtr();
+            }
+
+            if (CodeNodePtr rv = fold(call)) {
+                return rv;
+            }
+
+            Type type = node->getType();
+            string op = call->getOperator();
+
+            switch (call->getCallType()) {
+                case FunctionNode::INFIX: {
+                    const CodeNodePtr& lhs = args[0];
+                    const CodeNodePtr& rhs = args[1];
+                    if (op == "*") {
+                        if (isConstant(lhs, 0) || isConstant(rhs, 0)) {
+                            return makeZero(type);
+                        }
+                        if (isIdentity(rhs, lhs, type)) return lhs;
+                        if (isIdentity(lhs, rhs, type)) return rhs;
+                    } else if (op == "+") {
+                        if (isConstant(rhs, 0) && lhs->getType() == type) {
+                            return lhs;
+                        }
+                        if (isConstant(lhs, 0) && rhs->getType() == type) {
+                            return rhs;
+                        }
+                    } else if (op == "-") {
+                        if (isConstant(rhs, 0) && lhs->getType() == type) {
+                            return lhs;
+                        }
+                        if (isConstant(lhs, 0) && rhs->getType() == type) {
+                            CodeNodeList negated(1, rhs);
+                            return CodeNodePtr(new CallCodeNode(
+                                                   type, FunctionNode::PREFIX,
+                                                   "-", negated, LINEAR));
+                        }
+                    } else if (op == "/") {
+                        if (isIdentity(rhs, lhs, type)) return lhs;
+                    }
+                    break;
+                }
+
+                case FunctionNode::PREFIX: {
+                    REN_KIND_CAST(inner, CallCodeNode, args[0].get());
+                    if (op == "-" && inner &&
+                        inner->getCallType() == FunctionNode::PREFIX &&
+                        inner->getOperator() == "-"
+                    ) {
+                        return inner->getChildren()[0];
+                    }
+                    break;
+                }
+
+                case FunctionNode::FUNCTION: {
+                    if (op == "mix") {
+                        if (isConstant(args[2], 0)) return args[0];
+                        if (isConstant(args[2], 1)) return args[1];
+                    } else if (op == "pow") {
+                        if (isIdentity(args[1], args[0], type)) return args[0];
+                    }
+                    break;
+                }
+
+                default:
+                    break;
+            }
+            return CodeNodePtr();
+        }
+
+        /// Does multiplying other by one give other?
+        static bool isIdentity(
+            const CodeNodePtr& one,
+            const CodeNodePtr& other,
+            Type type
+        ) {
+            return isConstant(one, 1) && !isMatrix(one->getType()) &&
+                   other->getType() == type;
+        }
+
+        /// Evaluates calls on constants.
+        CodeNodePtr fold(CallCodeNode* call) {
+            Type type = call->getType();
+            if (!UniformProgram::canCall(call->getCallType(),
+                                         call->getOperator(), type)) {
+                return CodeNodePtr();
+            }
+
+            UniformProgram program;
+            UniformProgram::Instruction in(UniformProgram::CALL, type);
+            in.callType = call->getCallType();
+            in.name = call->getOperator();
+
+            const CodeNodeList& args = call->getChildren();
+            for (size_t i = 0; i < args.size(); ++i) {
+                ValuePtr value = getConstantValue(args[i]);
+                if (!value || getElementType(args[i]->getType()) == NullType) {
+                    return CodeNodePtr();
+                }
+                UniformProgram::Instruction load(UniformProgram::LOAD_CONSTANT,
+                                                 args[i]->getType());
+                load.value = value;
+                in.arguments.push_back(program.addInstruction(load));
+            }
+            program.addOutput("result", program.addInstruction(in));
+
+            UniformProgram::ValueMap results;
+            program.evaluate(UniformProgram::ValueMap(), results);
+            return makeLiteral(results["result"], type);
+        }
+
+        CodeNodePtr makeZero(Type type) {
+            return makeLiteral(Value::create(type), type);
+        }
+
+        CodeNodePtr makeLiteral(ValuePtr value, Type type) {
+            string text = formatLiteral(value, type);
+            if (text.empty()) {
+                return CodeNodePtr();
+            }
+
+            CodeNodePtr& rv = _literals[text];
+            if (!rv) {
+                rv.reset(new NameCodeNode(text, type, CONSTANT, value,
+                                          ValueNode::BUILTIN));
+            }
+            return rv;
+        }
+
+        CodeNodeSet _visited;
+        std::map<string, CodeNodePtr> _literals;
+    };
+
+    typedef std::map<CodeNode*, bool> HoistableMap;
+
+    /// Can the CPU compute node from uniforms and constants alone?
+    bool isHoistable(const CodeNodePtr& node, HoistableMap& memo) {
+        HoistableMap::const_iterator i = memo.find(node.get());
+        if (i != memo.end()) {
+            return i->second;
+        }
+
+        bool rv = false;
+        switch (node->getKind()) {
+            case CodeNode::NAME_CODE_NODE: {
+                NameCodeNode* p = static_cast<NameCodeNode*>(node.get());
+                rv = (p->getInputType() == ValueNode::UNIFORM ||
+                      (p->getFrequency() == CONSTANT && p->getValue())) &&
+                     getElementType(p->getType()) != NullType;
+                break;
+            }
+
+            case CodeNode::CALL_CODE_NODE: {
+                CallCodeNode* p = static_cast<CallCodeNode*>(node.get());
+                rv = UniformProgram::canCall(p->getCallType(),
+                                             p->getOperator(),
+                                             p->getType());
+                break;
+            }
+
+            case CodeNode::IF_CODE_NODE:
+                rv = true;
+                break;
+
+            default:
+                assert(!"Unknown code node type");
+        }
+
+        const CodeNodeList& children = node->getChildren();
+        for (size_t c = 0; rv && c < children.size(); ++c) {
+            rv = isHoistable(children[c], memo);
+        }
+
+        memo[node.get()] = rv;
+        return rv;
+    }
+
+    /// The largest hoistable uniform subexpressions under node.
+    void findHoistable(
+        const CodeNodePtr& node,
+        HoistableMap& hoistable,
+        CodeNodeSet& visited,
+        CodeNodeList& result
+    ) {
+        if (!visited.insert(node.get()).second) {
+            return;
+        }
+
+        if (node->getKind() != CodeNode::NAME_CODE_NODE &&
+            node->getFrequency() == UNIFORM &&
+            isHoistable(node, hoistable)
+        ) {
+            result.push_back(node);
+            return;
+        }
+
+        const CodeNodeList& children = node->getChildren();
+        for (size_t i = 0; i < children.size(); ++i) {
+            findHoistable(children[i], hoistable, visited, result);
+        }
+    }
+
+    typedef std::map<CodeNode*, size_t> InstructionMap;
+
+    /// Returns the instruction that computes node.
+    size_t addInstructions(
+        const CodeNodePtr& node,
+        UniformProgram& program,
+        InstructionMap& instructions
+    ) {
+        InstructionMap::const_iterator i = instructions.find(node.get());
+        if (i != instructions.end()) {
+            return i->second;
+        }
+
+        UniformProgram::Instruction in(UniformProgram::CALL,
+                                       node->getType());
+
+        switch (node->getKind()) {
+            case CodeNode::NAME_CODE_NODE: {
+                NameCodeNode* p = static_cast<NameCodeNode*>(node.get());
+                if (p->getInputType() == ValueNode::UNIFORM) {
+                    in.opcode = UniformProgram::LOAD_UNIFORM;
+                    in.name = p->getName();
+                } else {
+                    in.opcode = UniformProgram::LOAD_CONSTANT;
+                    in.value = p->getValue();
+                }
+                break;
+            }
+
+            case CodeNode::CALL_CODE_NODE: {
+                CallCodeNode* p = static_cast<CallCodeNode*>(node.get());
+                in.callType = p->getCallType();
+                in.name = p->getOperator();
+                break;
+            }
+
+            case CodeNode::IF_CODE_NODE:
+                in.opcode = UniformProgram::SELECT;
+                break;
+
+            default:
+                assert(!"Unknown code node type");
+        }
+
+        const CodeNodeList& children = node->getChildren();
+        for (size_t c = 0; c < children.size(); ++c) {
+            in.arguments.push_back(
+                addInstructions(children[c], program, instructions));
+        }
+
+        size_t rv = program.addInstruction(in);
+        instructions[node.get()] = rv;
+        return rv;
+    }
+
+    /**
+     * Rough ALU instructions to evaluate node once, not counting its
+     * children.  Only the ratios between these matter.
+     */
+    float getOperationCost(const CodeNodePtr& node) {
+        switch (node->getKind()) {
+            case CodeNode::NAME_CODE_NODE:
+                return 0;
+
+            case CodeNode::IF_CODE_NODE:
+                return 1;
+
+            case CodeNode::CALL_CODE_NODE: {
+                CallCodeNode* p = static_cast<CallCodeNode*>(node.get());
+                string op = p->getOperator();
+                Type type = p->getType();
+                switch (p->getCallType()) {
+                    case FunctionNode::SWIZZLE:
+                        return 0;
+
+                    case FunctionNode::INFIX:
+                        if (op == "*" &&
+                            isMatrix(p->getChildren()[0]->getType())) {
+                            // One dot product per row.
+                            return float(getVectorLength(type));
+                        }
+                        return (op == "/" ? 2.0f : 1.0f);
+
+                    case FunctionNode::FUNCTION:
+                        if (getVectorLength(type) > 1 &&
+                            op == type.getName()) {
+                            // Constructors only move components.
+                            return 0;
+                        }
+                        if (op == "normalize" || op == "reflect" ||
+                            op == "pow") {
+                            return 3;
+                        }
+                        if (op == "mix") {
+                            return 2;
+                        }
+                        if (op == "texture2D") {
+                            return 4;
+                        }
+                        return 1;
+
+                    default:
+                        return 1;
+                }
+            }
+
+            default:
+                assert(!"Unknown code node type");
+                return 0;
         }
     }
 
-    CodeNodePtr findEvaluatable(CodeNodePtr node) {
-        assert(node);
+    /**
+     * Decides which fragment shader expressions the vertex shader
+     * computes instead, by comparing what each costs per pixel: either
+     * evaluating it there, or interpolating a varying plus its share
+     * of the vertex shader's work.  interpolationCost is for a whole
+     * vec4.  Vertex inputs have no per-pixel
+     * choice; they, or something computed from them, must be lifted.
+     *
+     * A subexpression with several users is computed once, so each
+     * user is charged for its share.
+     */
+    class Placement {
+    public:
+        Placement(
+            const CodeNodeList& roots,
+            float interpolationCost,
+            float pixelsPerVertex
+        )
+        : _roots(roots)
+        , _interpolationCost(interpolationCost)
+        , _pixelsPerVertex(pixelsPerVertex) {
+            CodeNodeSet visited;
+            for (size_t i = 0; i < roots.size(); ++i) {
+                countUsers(roots[i], visited);
+            }
+        }
+
+        /// The nodes to lift, outermost first.
+        CodeNodeList findLifted() {
+            CodeNodeSet visited;
+            CodeNodeList candidates;
+            for (size_t i = 0; i < _roots.size(); ++i) {
+                findCandidates(_roots[i], visited, candidates);
+            }
+            CodeNodeSet lifted;
+            for (size_t i = 0; i < candidates.size(); ++i) {
+                lifted.insert(candidates[i].get());
+            }
+
+            // The costs above assume every user of a shared node
+            // computes it in the fragment shader.  When some of them
+            // lifted it anyway, deriving from its varying is cheaper
+            // than another varying.
+            CodeNodeList rv;
+            for (size_t i = 0; i < candidates.size(); ++i) {
+                if (isDerivable(candidates[i], lifted)) {
+                    lifted.erase(candidates[i].get());
+                } else {
+                    rv.push_back(candidates[i]);
+                }
+            }
+            return rv;
+        }
+
+        /// Writes a line per expression that could have been lifted.
+        void report(std::ostream& os, const CodeNodeList& lifted) {
+            CodeNodeSet visited;
+            CodeNodeSet liftedSet;
+            for (size_t i = 0; i < lifted.size(); ++i) {
+                liftedSet.insert(lifted[i].get());
+            }
+            for (size_t i = 0; i < _roots.size(); ++i) {
+                report(os, _roots[i], liftedSet, visited);
+            }
+        }
+
+    private:
+        struct Choice {
+            bool lift;
+            float keepCost;  ///< Negative if node must be lifted.
+            float liftCost;  ///< Negative if node can't be lifted.
+        };
+
+        static bool mustLift(const CodeNodePtr& node) {
+            REN_KIND_CAST(p, NameCodeNode, node.get());
+            return p && p->getFrequency() == VERTEX &&
+                   (p->getInputType() == ValueNode::BUILTIN ||
+                    p->getInputType() == ValueNode::ATTRIBUTE);
+        }
+
+        static bool canLift(const CodeNodePtr& node) {
+            return mustLift(node) ||
+                   (node->getKind() == CodeNode::CALL_CODE_NODE &&
+                    node->getFrequency() >= UNIFORM &&
+                    node->canInterpolate());
+        }
+
+        void findCandidates(
+            const CodeNodePtr& node,
+            CodeNodeSet& visited,
+            CodeNodeList& candidates
+        ) {
+            if (!visited.insert(node.get()).second) {
+                return;
+            }
+
+            if (decide(node).lift) {
+                candidates.push_back(node);
+                return;
+            }
+
+            const CodeNodeList& children = node->getChildren();
+            for (size_t i = 0; i < children.size(); ++i) {
+                findCandidates(children[i], visited, candidates);
+            }
+        }
+
+        /// Can the fragment shader cheaply compute node from varyings
+        /// that are already there?
+        bool isDerivable(const CodeNodePtr& node, const CodeNodeSet& lifted) {
+            const CodeNodeList& children = node->getChildren();
+            if (children.empty()) {
+                return false;
+            }
+            for (size_t i = 0; i < children.size(); ++i) {
+                if (children[i]->getFrequency() >= VERTEX &&
+                    !lifted.count(children[i].get())) {
+                    return false;
+                }
+            }
+            return getOperationCost(node) < decide(node).liftCost;
+        }
+
+        void report(
+            std::ostream& os,
+            const CodeNodePtr& node,
+            const CodeNodeSet& lifted,
+            CodeNodeSet& visited
+        ) {
+            if (!visited.insert(node.get()).second) {
+                return;
+            }
+
+            const Choice& choice = decide(node);
+            if (lifted.count(node.get())) {
+                os << "lift " << node->asExpression() << ": "
+                   << choice.liftCost << " per pixel";
+                if (choice.keepCost >= 0) {
+                    os << " instead of " << choice.keepCost;
+                }
+                os << "\n";
+                return;
+            }
+
+            if (choice.lift) {
+                os << "keep " << node->asExpression()
+                   << ": derived from other varyings\n";
+            } else if (choice.liftCost >= 0) {
+                os << "keep " << node->asExpression() << ": "
+                   << choice.keepCost << " per pixel instead of "
+                   << choice.liftCost << "\n";
+            }
+
+            const CodeNodeList& children = node->getChildren();
+            for (size_t i = 0; i < children.size(); ++i) {
+                report(os, children[i], lifted, visited);
+            }
+        }
+
+        const Choice& decide(const CodeNodePtr& node) {
+            ChoiceMap::iterator i = _choices.find(node.get());
+            if (i != _choices.end()) {
+                return i->second;
+            }
+
+            Choice c;
+            c.keepCost = -1;
+            c.liftCost = -1;
+
+            if (!mustLift(node)) {
+                c.keepCost = getOperationCost(node);
+                const CodeNodeList& children = node->getChildren();
+                for (size_t i = 0; i < children.size(); ++i) {
+                    const Choice& child = decide(children[i]);
+                    c.keepCost += (child.lift ? child.liftCost
+                                              : child.keepCost) /
+                                  _users[children[i].get()];
+                }
+            }
 
-        if (REN_DYNAMIC_CAST_PTR(p, IfCodeNode, node)) {
-            if (p->getChildren()[0]->getFrequency() == CONSTANT) {
-                return p;
+            if (canLift(node)) {
+                // Interpolation is paid per component.
+                float components = float(getArity(node->getType()));
+                c.liftCost = _interpolationCost * components / 4 +
+                             getVertexCost(node) / _pixelsPerVertex;
             }
+
+            // Ties go to the vertex shader, which runs less often.
+            c.lift = (c.liftCost >= 0 &&
+                      (c.keepCost < 0 || c.liftCost <= c.keepCost));
+            return _choices[node.get()] = c;
         }
 
-        CodeNodeList args = node->getChildren();
-        for (size_t i = 0; i < args.size(); ++i) {
-            if (CodeNodePtr c = findEvaluatable(args[i])) {
-                return c;
+        void countUsers(const CodeNodePtr& node, CodeNodeSet& visited) {
+            if (!visited.insert(node.get()).second) {
+                return;
+            }
+            const CodeNodeList& children = node->getChildren();
+            for (size_t i = 0; i < children.size(); ++i) {
+                ++_users[children[i].get()];
+                countUsers(children[i], visited);
             }
         }
-        return CodeNodePtr();        
+
+        float getVertexCost(const CodeNodePtr& node) {
+            std::map<CodeNode*, float>::iterator i =
+                _vertexCosts.find(node.get());
+            if (i != _vertexCosts.end()) {
+                return i->second;
+            }
+
+            float rv = getOperationCost(node);
+            const CodeNodeList& children = node->getChildren();
+            for (size_t i = 0; i < children.size(); ++i) {
+                rv += getVertexCost(children[i]);
+            }
+            return _vertexCosts[node.get()] = rv;
+        }
+
+        CodeNodeList _roots;
+
+        typedef std::map<CodeNode*, Choice> ChoiceMap;
+        ChoiceMap _choices;
+        std::map<CodeNode*, unsigned> _users;
+        std::map<CodeNode*, float> _vertexCosts;
+
+        float _interpolationCost;
+        float _pixelsPerVertex;
+    };
+
+    /// A vec4 interpolator, and the lifted expressions that share it.
+    struct Slot {
+        Slot()
+        : components(0)
+        , first(0) {
+        }
+
+        std::vector<size_t> members;  ///< Indices into the lifted list.
+        unsigned components;
+        size_t first;                 ///< The smallest member.
+    };
+    typedef std::vector<Slot> SlotList;
+
+    bool isPackable(Type type) {
+        return type == FLOAT || type == VEC2 || type == VEC3;
+    }
+
+    struct LargerFirst {
+        LargerFirst(const CodeNodeList& lifted_)
+        : lifted(lifted_) {
+        }
+
+        bool operator()(size_t a, size_t b) const {
+            return getArity(lifted[a]->getType()) >
+                   getArity(lifted[b]->getType());
+        }
+
+        const CodeNodeList& lifted;
+    };
+
+    bool isEarlier(const Slot& a, const Slot& b) {
+        return a.first < b.first;
+    }
+
+    /**
+     * First-fit bin packing of floats and float vectors into vec4
+     * slots, largest first.  Anything else gets a slot of its own.
+     * Slots are ordered by their earliest member, so varyings are
+     * numbered as they would be without packing.
+     */
+    SlotList packVaryings(const CodeNodeList& lifted) {
+        std::vector<size_t> order;
+        for (size_t i = 0; i < lifted.size(); ++i) {
+            order.push_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), LargerFirst(lifted));
+
+        SlotList slots;
+        for (size_t i = 0; i < order.size(); ++i) {
+            Type type = lifted[order[i]]->getType();
+            unsigned size = (isPackable(type) ? getArity(type) : 4);
+
+            size_t s = 0;
+            while (s < slots.size() && slots[s].components + size > 4) {
+                ++s;
+            }
+            if (s == slots.size()) {
+                slots.push_back(Slot());
+                slots[s].first = order[i];
+            }
+
+            Slot& slot = slots[s];
+            slot.members.push_back(order[i]);
+            slot.components += size;
+            slot.first = std::min(slot.first, order[i]);
+        }
+
+        std::sort(slots.begin(), slots.end(), isEarlier);
+        return slots;
     }
 }
 
 
 namespace ren {
 
+    ShadeGraph::ShadeGraph()
+    : maxVaryings(8)
+    , pixelsPerVertex(8)
+    , placementReport(0)
+    , uniformLayout(0) {
+    }
+
+
     void ShadeGraph::specialize() {
-        // This needs access to the constants defined outside of the
-        // compiler.
-
-        while (CodeNodePtr eval = findEvaluatable()) {
-            REN_DYNAMIC_CAST_PTR(p, IfCodeNode, eval);
-            assert(p);
-
-            CodeNodePtr condition = p->getChildren()[0];
-            assert(condition->getFrequency() == CONSTANT);
-            assert(condition->getType() == BOOL);
-            
-            /// @todo  The condition may not always be a name.
-            REN_DYNAMIC_CAST_PTR(n, NameCodeNode, condition);
-            assert(n);
-
-            bool value = n->getValue()->asBool();
-            if (value) {
-                replace(eval, p->getChildren()[1]);
-            } else {
-                replace(eval, p->getChildren()[2]);
+        Simplifier simplifier;
+        OutputMap::iterator i = outputs.begin();
+        for (; i != outputs.end(); ++i) {
+            CodeNodePtr node = i->second;
+            CodeNodePtr with = simplifier.simplify(node);
+            if (with != node) {
+                replace(node, with);
             }
         }
     }
 
+    void ShadeGraph::hoistUniforms(UniformProgram& program) {
+        HoistableMap hoistable;
+        CodeNodeSet visited;
+        CodeNodeList hoisted;
+        OutputMap::const_iterator i = outputs.begin();
+        for (; i != outputs.end(); ++i) {
+            findHoistable(i->second, hoistable, visited, hoisted);
+        }
+
+        // Build the whole program before touching the graph, since
+        // hoisted subexpressions may share nodes.
+        InstructionMap instructions;
+        std::vector<size_t> results;
+        for (size_t h = 0; h < hoisted.size(); ++h) {
+            results.push_back(
+                addInstructions(hoisted[h], program, instructions));
+        }
+
+        for (size_t h = 0; h < hoisted.size(); ++h) {
+            std::ostringstream name;
+            name << "_ren_u" << h;
+            program.addOutput(name.str(), results[h]);
+
+            CodeNodePtr uniform(new NameCodeNode(
+                                    name.str(), hoisted[h]->getType(),
+                                    UNIFORM, NullValue,
+                                    ValueNode::UNIFORM));
+            replace(hoisted[h], uniform);
+        }
+    }
+
+
+    /// Reads the uniforms the layout places from its array instead of
+    /// from uniforms of their own.
+    void packUniforms(GLSLShader& sh, const UniformLayout& layout) {
+        NameCodeNodeSet uniforms;
+        getReferencesOfType(uniforms, sh.main, ValueNode::UNIFORM);
+
+        bool packed = false;
+        for (NameCodeNodeSet::iterator i = uniforms.begin();
+             i != uniforms.end();
+             ++i
+        ) {
+            const UniformLayout::Entry* e = layout.find((*i)->getName());
+            if (!e) {
+                // Samplers, and uniforms introduced by hoisting.
+                continue;
+            }
+
+            // A builtin name is written out as is, without a
+            // declaration.
+            CodeNodePtr reference(new NameCodeNode(
+                                      UniformLayout::getReference(*e),
+                                      e->type, UNIFORM, NullValue,
+                                      ValueNode::BUILTIN));
+            replaceUses(*i, reference);
+            packed = true;
+        }
+
+        if (packed) {
+            std::ostringstream name;
+            name << UniformLayout::ARRAY_NAME
+                 << '[' << layout.getSize() / 4 << ']';
+
+            GLSLShader::Uniform u;
+            u.name = name.str();
+            u.type = VEC4.getName();
+            sh.uniforms.push_back(u);
+        }
+    }
+
+
     void declareInputs(GLSLShader& sh) {
         StatementPtr main_stmt(sh.main);
 
@@ -139,16 +967,19 @@ namespace ren {
     }
 
     void ShadeGraph::generate(GLSLShader& vs, GLSLShader& fs) {
-        if (outputs.count("gl_Position")) {
-            CodeNodePtr cn = outputs["gl_Position"];
+        // Sharing and lifting rewrite nodes in place, so the vertex
+        // shader gets its own copy of any nodes the stages have in
+        // common.
+        CopyMap vertexCopies;
 
-            typedef std::set<ValueNodePtr> ValueNodeSet;
+        if (outputs.count("gl_Position")) {
+            CodeNodePtr cn = copy(outputs["gl_Position"], vertexCopies);
 
             // Add statements.
             AssignmentPtr s(new Assignment);
             s->define = false;
             s->lhs = "gl_Position";
-            s->rhs = cn;
+            s->setExpression(cn);
             vs.main->statements.push_back(s);
         }
 
@@ -159,83 +990,142 @@ namespace ren {
             AssignmentPtr s(new Assignment);
             s->define = false;
             s->lhs = "gl_FragColor";
-            s->rhs = cn;
+            s->setExpression(cn);
             fs.main->statements.push_back(s);
         }
 
-        lift(vs, fs);
+        lift(vs, fs, vertexCopies);
+        if (uniformLayout) {
+            packUniforms(vs, *uniformLayout);
+            packUniforms(fs, *uniformLayout);
+        }
         declareInputs(vs);
         declareInputs(fs);
     }
 
 
-    CodeNodePtr ShadeGraph::findEvaluatable() {
-        OutputMap::const_iterator i = outputs.begin();
-        for (; i != outputs.end(); ++i) {
-            if (CodeNodePtr cn = ::findEvaluatable(i->second)) {
-                return cn;
-            }
-        }
-        return CodeNodePtr();
-    }
-
-
     void ShadeGraph::replace(CodeNodePtr node, CodeNodePtr with) {
         OutputMap::iterator i = outputs.begin();
         for (; i != outputs.end(); ++i) {
             if (i->second == node) {
                 i->second = with;
-            } else {
-                ren::replace(i->second, node, with);
             }
-        }        
+        }
+        ren::replaceUses(node, with);
     }
 
 
-    void ShadeGraph::lift(GLSLShader& vs, GLSLShader& fs) {
-        StatementPtr main_stmt(fs.main);
+    void ShadeGraph::lift(
+        GLSLShader& vs,
+        GLSLShader& fs,
+        CopyMap& vertexCopies
+    ) {
+        CodeNodeList roots;
+        const StatementList& statements = fs.main->statements;
+        for (size_t i = 0; i < statements.size(); ++i) {
+            if (CodeNodePtr e = statements[i]->getExpression()) {
+                roots.push_back(e);
+            }
+        }
+
+        // Making varyings more expensive trades per-pixel work for
+        // fewer of them, until they fit.
+        CodeNodeList lifted;
+        SlotList slots;
+        float interpolationCost = 1;
+        for (;;) {
+            Placement placement(roots, interpolationCost, pixelsPerVertex);
+            lifted = placement.findLifted();
+            slots = packVaryings(lifted);
 
-/*
-        std::cout << "########\n";
-        vs.output(std::cout);
-        std::cout << "--------\n";
-        fs.output(std::cout);
-*/
+            if (slots.size() <= maxVaryings) {
+                if (placementReport) {
+                    placement.report(*placementReport, lifted);
+                }
+                break;
+            }
 
-        while (CodeNodePtr varying = findInterpolatable(main_stmt)) {
+            if (interpolationCost > 1e6f) {
+                std::ostringstream os;
+                os << "Fragment shader needs " << slots.size()
+                   << " vec4 varyings, but the limit is " << maxVaryings
+                   << ".";
+                throw CompileError(os.str());
+            }
+            interpolationCost *= 2;
+        }
+
+        for (size_t s = 0; s < slots.size(); ++s) {
+            const Slot& slot = slots[s];
             string name = fs.newVaryingName();
 
+            // A slot with several members is a vec4 that each of them
+            // reads and writes a swizzle of.
+            bool packed = (slot.members.size() > 1);
+            CodeNodePtr packedReference;
+            if (packed) {
+                Frequency frequency = CONSTANT;
+                for (size_t m = 0; m < slot.members.size(); ++m) {
+                    frequency = std::max(
+                        frequency, lifted[slot.members[m]]->getFrequency());
+                }
+                packedReference.reset(
+                    new NameCodeNode(
+                        name, VEC4, frequency, NullValue,
+                        ValueNode::VARYING));
+            }
+
             GLSLShader::Varying v;
             v.name = name;
-            v.type = varying->getType().getName();
+            v.type = (packed ? VEC4 : lifted[slot.members[0]]->getType())
+                .getName();
 
             // Link shaders through a varying.
             vs.varyings.push_back(v);
             fs.varyings.push_back(v);
 
-            // Define the varying in the vertex shader.
-            AssignmentPtr assignVarying(new Assignment);
-            assignVarying->define = false;
-            assignVarying->lhs = name;
-            assignVarying->rhs = varying;
-            vs.main->statements.push_back(assignVarying);
+            unsigned offset = 0;
+            for (size_t m = 0; m < slot.members.size(); ++m) {
+                CodeNodePtr varying = lifted[slot.members[m]];
 
-            // Reference the varying from the fragment shader.
-            CodeNodePtr varyingReference(
-                    new NameCodeNode(
-                        name,
-                        varying->getType(),
-                        varying->getFrequency(),
-                        NullValue,
-                        ValueNode::VARYING));
-            ren::replace(main_stmt, varying, varyingReference);
-
-/*
-            std::cout << "########\n";
-            vs.output(std::cout);
-            std::cout << "--------\n";
-            fs.output(std::cout);
-*/
+                // Define the varying in the vertex shader.
+                AssignmentPtr assignVarying(new Assignment);
+                assignVarying->define = false;
+                assignVarying->lhs = name;
+                assignVarying->setExpression(copy(varying, vertexCopies));
+                vs.main->statements.push_back(assignVarying);
+
+                // Reference the varying from the fragment shader.
+                CodeNodePtr varyingReference;
+                if (packed) {
+                    unsigned size = getArity(varying->getType());
+                    string swizzle = string("xyzw").substr(offset, size);
+                    offset += size;
+
+                    assignVarying->lhs += "." + swizzle;
+                    varyingReference.reset(
+                        new CallCodeNode(
+                            varying->getType(),
+                            FunctionNode::SWIZZLE,
+                            swizzle,
+                            CodeNodeList(1, packedReference),
+                            LINEAR));
+                } else {
+                    varyingReference.reset(
+                        new NameCodeNode(
+                            name,
+                            varying->getType(),
+                            varying->getFrequency(),
+                            NullValue,
+                            ValueNode::VARYING));
+                }
+                replaceUses(varying, varyingReference);
+
+                // If a later varying is computed from this one, the
+                // vertex shader uses the original expression.
+                vertexCopies[varyingReference] =
+                    assignVarying->getExpression();
+            }
         }
     }
 
@@ -2,9 +2,12 @@
 #define REN_SHADE_GRAPH_H
 
 
+#include <iostream>
 #include <map>
 #include "CodeNode.h"
 #include "GLSLShader.h"
+#include "UniformLayout.h"
+#include "UniformProgram.h"
 
 
 namespace ren {
@@ -14,16 +17,46 @@ namespace ren {
         typedef std::map<string, CodeNodePtr> OutputMap;
         OutputMap outputs;
 
-        /// Evaluate constant-frequency computations.
+        /// vec4 varyings the stages may link through.  Smaller ones are
+        /// packed together.  generate() throws a CompileError if the
+        /// fragment shader needs more.
+        unsigned maxVaryings;
+
+        /// How many pixels each vertex covers, on average.  The fewer
+        /// there are, the less moving work to the vertex shader saves.
+        float pixelsPerVertex;
+
+        /// If set, generate() writes why it placed each expression in
+        /// the stage it did.
+        std::ostream* placementReport;
+
+        /// If set, generate() reads the uniforms it places out of one
+        /// array of vec4s.
+        const UniformLayout* uniformLayout;
+
+        ShadeGraph();
+
+        /**
+         * Evaluate constant-frequency computations, and simplify the
+         * arithmetic they leave behind, such as x * 0.0 or x + 0.0.
+         * Conditions that are plain constants were already resolved
+         * by CompilationContext::evaluate; this catches the rest.
+         */
         void specialize();
 
+        /**
+         * Move uniform-frequency subexpressions that the CPU can
+         * evaluate into program, and read their results from new
+         * uniforms instead.
+         */
+        void hoistUniforms(UniformProgram& program);
+
         void generate(GLSLShader& vs, GLSLShader& fs);
 
     private:
-        CodeNodePtr findEvaluatable();
         void replace(CodeNodePtr node, CodeNodePtr with);
 
-        void lift(GLSLShader& vs, GLSLShader& fs);
+        void lift(GLSLShader& vs, GLSLShader& fs, CopyMap& vertexCopies);
     };
 
 }
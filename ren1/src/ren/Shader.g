@@ -171,13 +171,13 @@ program returns [ProgramPtr p] {
             }
         |
             #(ATTRIBUTE atype:ID aname:ID) {
-                p->attributes.push_back(Input(
+                p->addAttribute(Input(
                         getTypeFromString(atype->getText()),
                         aname->getText()));
             }
         |
             def=definition {
-                p->definitions.push_back(def);
+                p->addDefinition(def);
             }
         )*
     ;
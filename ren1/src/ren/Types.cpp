@@ -1,36 +1,48 @@
+#include <map>
 #include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
 #include "Errors.h"
 #include "Types.h"
 
 
 namespace ren {
 
+    /// Zero-initialized, so it's ready before any constructor runs.
+    static unsigned nextTypeId;
+
+
+    /**
+     * There is exactly one TypeObject per distinct type, so types
+     * compare by identity.  Tuples and functions are made only through
+     * the tables below.  TypeObjects are never destroyed.
+     */
     class TypeObject : public boost::noncopyable {
     public:
-        // This virtual destructor isn't strictly necessary, because we use
-        // boost::shared_ptr.  But gcc complains.  Loudly.
+        TypeObject()
+        : _id(nextTypeId++) {
+        }
+
+        // Shut up gcc.
         virtual ~TypeObject() { }
 
         virtual const string getName() const = 0;
-        virtual bool operator==(const TypeObject& rhs) const = 0;
 
-        bool operator!=(const TypeObject& rhs) const {
-            return !(*this == rhs);
+        unsigned getId() const {
+            return _id;
         }
+
+    private:
+        unsigned _id;
     };
-    typedef std::vector<TypeObjectPtr> TypeObjectList;
+    typedef std::vector<const TypeObject*> TypeObjectList;
 
 
     class NullTypeObject : public TypeObject {
         const string getName() const {
             return "null";
         }
-
-        bool operator==(const TypeObject& rhs) const {
-            return dynamic_cast<const NullTypeObject*>(&rhs);
-        }
     };
-    REN_SHARED_PTR(NullTypeObject);
 
 
 #define REN_PRIMITIVE_TYPES                                             \
@@ -86,14 +98,6 @@ namespace ren {
             }
         }
 
-        bool operator==(const TypeObject& rhs) const {
-            if (REN_DYNAMIC_CAST(p, const PrimitiveType*, &rhs)) {
-                return _code == p->_code;
-            } else {
-                return false;
-            }
-        }
-
     private:
         PrimitiveTypeCode _code;
     };
@@ -121,22 +125,6 @@ namespace ren {
             return result;
         }
 
-        bool operator==(const TypeObject& rhs) const {
-            if (REN_DYNAMIC_CAST(p, const TupleTypeObject*, &rhs)) {
-                if (_elements.size() != p->_elements.size()) {
-                    return false;
-                }
-                for (size_t i = 0; i < _elements.size(); ++i) {
-                    if (*(_elements[i]) != *(p->_elements[i])) {
-                        return false;
-                    }
-                }
-                return true;
-            } else {
-                return false;
-            }
-        }
-
         const TypeObjectList& getElements() const {
             return _elements;
         }
@@ -144,12 +132,12 @@ namespace ren {
     private:
         TypeObjectList _elements;
     };
-    REN_SHARED_PTR(TupleTypeObject);
 
 
     class FunctionTypeObject : public TypeObject {
     public:
-        FunctionTypeObject(NotNull<TypeObjectPtr> in, NotNull<TypeObjectPtr> out)
+        FunctionTypeObject(NotNull<const TypeObject*> in,
+                           NotNull<const TypeObject*> out)
         : _in(in)
         , _out(out) {
         }
@@ -158,52 +146,130 @@ namespace ren {
             return "(" + _in->getName() + " -> " + _out->getName() + ")";
         }
 
-        bool operator==(const TypeObject& rhs) const {
-            if (REN_DYNAMIC_CAST(p, const FunctionTypeObject*, &rhs)) {
-                return *_in == *p->_in && *_out == *p->_out;
-            } else {
-                return false;
-            }
-        }
-
-        TypeObjectPtr getInType()  const { return _in;  }
-        TypeObjectPtr getOutType() const { return _out; }
+        const TypeObject* getInType()  const { return _in;  }
+        const TypeObject* getOutType() const { return _out; }
 
     private:
-        TypeObjectPtr _in;
-        TypeObjectPtr _out;
+        const TypeObject* _in;
+        const TypeObject* _out;
     };
-    REN_SHARED_PTR(FunctionTypeObject);
 
 
-    Type::Type(NotNull<TypeObject*> object)
-    : _object(object.get()) {
+    typedef std::map<TypeObjectList, const TypeObject*> TupleTable;
+
+    typedef std::pair<const TypeObject*, const TypeObject*> FunctionKey;
+    typedef std::map<FunctionKey, const TypeObject*> FunctionTable;
+
+
+    /// Guards the tables below, which compiles on any thread add to.
+    /// Constructed on first use, like them.
+    static boost::mutex& getTableMutex() {
+        static boost::mutex mutex;
+        return mutex;
     }
 
-    Type::Type(NotNull<TypeObjectPtr> object)
-    : _object(object.get()) {
+    /// Makes sure the mutex exists before main() can start threads.
+    static boost::mutex& tableMutex = getTableMutex();
+
+
+    /**
+     * The types a thread has already looked up.  Types live forever,
+     * so a thread can keep them without the lock, and since most
+     * lookups find a type that exists, they rarely take it.
+     */
+    struct LocalTables {
+        TupleTable tuples;
+        FunctionTable functions;
+    };
+
+    static boost::thread_specific_ptr<LocalTables>& getLocalTablesPtr() {
+        static boost::thread_specific_ptr<LocalTables> tables;
+        return tables;
     }
 
-    Type::Type(const Type& rhs)
-    : _object(rhs.get()) {
+    /// Makes sure the pointer exists before main() can start threads.
+    static boost::thread_specific_ptr<LocalTables>& localTablesPtr =
+        getLocalTablesPtr();
+
+    static LocalTables& getLocalTables() {
+        boost::thread_specific_ptr<LocalTables>& tables =
+            getLocalTablesPtr();
+        if (!tables.get()) {
+            tables.reset(new LocalTables);
+        }
+        return *tables;
     }
 
-    const string Type::getName() const {
-        return _object->getName();
+
+    /// Returns the one tuple with these elements.
+    static const TypeObject* internTuple(const TypeObjectList& elements) {
+        TupleTable& local = getLocalTables().tuples;
+        TupleTable::iterator i = local.find(elements);
+        if (i != local.end()) {
+            return i->second;
+        }
+
+        const TypeObject* rv;
+        {
+            boost::mutex::scoped_lock lock(getTableMutex());
+
+            // Constructed on first use: types may be built during
+            // static initialization of other translation units.
+            static TupleTable tuples;
+
+            const TypeObject*& t = tuples[elements];
+            if (!t) {
+                t = new TupleTypeObject(elements);
+            }
+            rv = t;
+        }
+        local.insert(TupleTable::value_type(elements, rv));
+        return rv;
+    }
+
+
+    /// Returns the one function type from in to out.
+    static const TypeObject* internFunction(const TypeObject* in,
+                                            const TypeObject* out) {
+        FunctionKey key(in, out);
+        FunctionTable& local = getLocalTables().functions;
+        FunctionTable::iterator i = local.find(key);
+        if (i != local.end()) {
+            return i->second;
+        }
+
+        const TypeObject* rv;
+        {
+            boost::mutex::scoped_lock lock(getTableMutex());
+            static FunctionTable functions;
+
+            const TypeObject*& f = functions[key];
+            if (!f) {
+                f = new FunctionTypeObject(in, out);
+            }
+            rv = f;
+        }
+        local.insert(FunctionTable::value_type(key, rv));
+        return rv;
+    }
+
+
+    Type::Type(NotNull<const TypeObject*> object)
+    : _object(object.get()) {
     }
 
-    bool Type::operator==(const Type& rhs) const {
-        return *_object == *rhs._object;
+    const string Type::getName() const {
+        return _object->getName();
     }
 
-    bool Type::operator!=(const Type& rhs) const {
-        return !(*this == rhs);
+    unsigned Type::getId() const {
+        return _object->getId();
     }
 
 
     Type operator*(Type lhs, Type rhs) {
-        REN_DYNAMIC_CAST_PTR(lhs_n, NullTypeObject, lhs.get());
-        REN_DYNAMIC_CAST_PTR(rhs_n, NullTypeObject, rhs.get());
+        REN_DYNAMIC_CAST(lhs_n, const NullTypeObject*, lhs.get());
+        REN_DYNAMIC_CAST(rhs_n, const NullTypeObject*, rhs.get());
 
         if (lhs_n) {
             return rhs;
@@ -211,8 +277,8 @@ namespace ren {
             return lhs;
         }
 
-        REN_DYNAMIC_CAST_PTR(lhs_t, TupleTypeObject, lhs.get());
-        REN_DYNAMIC_CAST_PTR(rhs_t, TupleTypeObject, rhs.get());
+        REN_DYNAMIC_CAST(lhs_t, const TupleTypeObject*, lhs.get());
+        REN_DYNAMIC_CAST(rhs_t, const TupleTypeObject*, rhs.get());
 
         if (lhs_t && rhs_t) {
 
@@ -220,13 +286,13 @@ namespace ren {
             newElements.insert(newElements.end(),
                                rhs_t->getElements().begin(),
                                rhs_t->getElements().end());
-            return Type(new TupleTypeObject(newElements));
+            return Type(internTuple(newElements));
 
         } else if (lhs_t) {
 
             TypeObjectList newElements(lhs_t->getElements());
             newElements.push_back(rhs.get());
-            return Type(new TupleTypeObject(newElements));
+            return Type(internTuple(newElements));
 
         } else if (rhs_t) {
 
@@ -234,22 +300,22 @@ namespace ren {
             newElements.insert(newElements.end(),
                                rhs_t->getElements().begin(),
                                rhs_t->getElements().end());
-            return Type(new TupleTypeObject(newElements));
+            return Type(internTuple(newElements));
 
         } else {
 
             TypeObjectList newElements(2);
             newElements[0] = lhs.get();
             newElements[1] = rhs.get();
-            return Type(new TupleTypeObject(newElements));
+            return Type(internTuple(newElements));
 
         }
     }
 
 
     Type operator>>(Type lhs, Type rhs) {
-        REN_DYNAMIC_CAST_PTR(lhs_n, NullTypeObject, lhs.get());
-        REN_DYNAMIC_CAST_PTR(rhs_n, NullTypeObject, rhs.get());
+        REN_DYNAMIC_CAST(lhs_n, const NullTypeObject*, lhs.get());
+        REN_DYNAMIC_CAST(rhs_n, const NullTypeObject*, rhs.get());
 
         if (lhs_n) {
             return rhs;
@@ -257,9 +323,7 @@ namespace ren {
             return lhs;
         }
 
-        return Type(TypeObjectPtr(new FunctionTypeObject(
-                                      lhs.get(),
-                                      rhs.get())));
+        return Type(internFunction(lhs.get(), rhs.get()));
     }
 
 
@@ -273,9 +337,9 @@ namespace ren {
 
 
     TypeList asTuple(Type t) {
-        if (dynamic_cast<NullTypeObject*>(t.get().get())) {
+        if (dynamic_cast<const NullTypeObject*>(t.get())) {
             return TypeList();
-        } else if (REN_DYNAMIC_CAST(p, TupleTypeObject*, t.get().get())) {
+        } else if (REN_DYNAMIC_CAST(p, const TupleTypeObject*, t.get())) {
             TypeList rv;
             for (size_t i = 0; i < p->getElements().size(); ++i) {
                 rv.push_back(Type(p->getElements()[i]));
@@ -288,7 +352,7 @@ namespace ren {
 
 
     Function asFunction(Type t) {
-        if (REN_DYNAMIC_CAST(p, FunctionTypeObject*, t.get().get())) {
+        if (REN_DYNAMIC_CAST(p, const FunctionTypeObject*, t.get())) {
             return Function(Type(p->getInType()), Type(p->getOutType()));
         } else {
             return Function(NullType, t);
@@ -384,6 +448,10 @@ namespace ren {
         return NullType;
     }
 
+    bool isMatrix(Type t) {
+        return t == MAT2 || t == MAT3 || t == MAT4;
+    }
+
 
 
     const Type NullType(new NullTypeObject);
@@ -9,34 +9,39 @@
 namespace ren {
 
     class TypeObject;
-    REN_SHARED_PTR(TypeObject);
 
     /**
      * A value-semantics TypeObject wrapper, so I don't go insane with
      * Java-ish code.
+     *
+     * TypeObjects are interned, so a Type is just a pointer and
+     * equality and ordering are O(1).
      */
     class Type {
     public:
-        Type(NotNull<TypeObject*> object);
-        Type(NotNull<TypeObjectPtr> object);
-        Type(const Type& rhs);
+        Type(NotNull<const TypeObject*> object);
 
         const string getName() const;
 
-        bool operator==(const Type& rhs) const;
-        bool operator!=(const Type& rhs) const;
+        /// Unique per type and stable for one run.  Usable as a hash.
+        unsigned getId() const;
+
+        bool operator==(const Type& rhs) const {
+            return _object == rhs._object;
+        }
+        bool operator!=(const Type& rhs) const {
+            return _object != rhs._object;
+        }
         bool operator<(const Type& rhs) const {
-            // We're going to treat name as being the unique "canonical"
-            // version of the type.
-            return getName() < rhs.getName();
+            return getId() < rhs.getId();
         }
 
-        TypeObjectPtr get() const {
+        const TypeObject* get() const {
             return _object;
         }
 
     private:
-        TypeObjectPtr _object;
+        const TypeObject* _object;
     };
     typedef std::vector<Type> TypeList;
 
@@ -72,6 +77,7 @@ namespace ren {
     Type getVectorType(Type element, unsigned length);
     unsigned getMatrixLength(Type t);
     Type getMatrixType(Type t, unsigned length);
+    bool isMatrix(Type t);
 
 
     extern const Type NullType;
@@ -0,0 +1,132 @@
+#include <sstream>
+#include "UniformLayout.h"
+
+
+namespace ren {
+
+    namespace {
+
+        /// Columns in a matrix, or 0 if the type isn't one.
+        unsigned getColumnCount(Type type) {
+            switch (getMatrixLength(type)) {
+                case 4:  return 2;
+                case 9:  return 3;
+                case 16: return 4;
+                default: return 0;
+            }
+        }
+
+
+        string getSlotReference(size_t slot) {
+            std::ostringstream os;
+            os << UniformLayout::ARRAY_NAME << '[' << slot << ']';
+            return os.str();
+        }
+
+
+        string getVectorReference(size_t offset, unsigned length) {
+            string rv = getSlotReference(offset / 4);
+            if (length < 4) {
+                rv += "." + string("xyzw").substr(offset % 4, length);
+            }
+            return rv;
+        }
+
+    }
+
+
+    const char* const UniformLayout::ARRAY_NAME = "_ren_uniforms";
+
+
+    bool UniformLayout::canPack(Type type) {
+        return getElementType(type) != NullType;
+    }
+
+
+    bool UniformLayout::add(const string& name, Type type) {
+        if (!canPack(type) || _indices.count(name)) {
+            return false;
+        }
+
+        size_t size;
+        size_t alignment;
+        if (unsigned columns = getColumnCount(type)) {
+            size = columns * 4;
+            alignment = 4;
+        } else {
+            size = getVectorLength(type);
+            alignment = (size == 1 ? 1 : size == 2 ? 2 : 4);
+        }
+
+        Entry e(name, type, (_size + alignment - 1) / alignment * alignment);
+
+        _indices[name] = _entries.size();
+        _entries.push_back(e);
+        _size = e.offset + size;
+        return true;
+    }
+
+
+    const UniformLayout::Entry* UniformLayout::find(
+        const string& name
+    ) const {
+        std::map<string, size_t>::const_iterator i = _indices.find(name);
+        if (i == _indices.end()) {
+            return 0;
+        }
+        return &_entries[i->second];
+    }
+
+
+    string UniformLayout::getReference(const Entry& entry) {
+        if (unsigned columns = getColumnCount(entry.type)) {
+            string rv = entry.type.getName() + "(";
+            for (unsigned c = 0; c < columns; ++c) {
+                if (c != 0) {
+                    rv += ", ";
+                }
+                rv += getVectorReference(entry.offset + c * 4, columns);
+            }
+            return rv + ")";
+        }
+
+        string rv = getVectorReference(
+            entry.offset, getVectorLength(entry.type));
+        if (getElementType(entry.type) != FLOAT) {
+            // Converting back from float is exact for bools and for
+            // ints up to 2^24.
+            rv = entry.type.getName() + "(" + rv + ")";
+        }
+        return rv;
+    }
+
+
+    void UniformLayout::write(
+        float* buffer,
+        const Entry& entry,
+        const Value& v
+    ) {
+        float* p = buffer + entry.offset;
+        if (unsigned columns = getColumnCount(entry.type)) {
+            const float* data = v.asFloatVec();
+            for (unsigned c = 0; c < columns; ++c) {
+                std::copy(data + c * columns, data + (c + 1) * columns,
+                          p + c * 4);
+            }
+            return;
+        }
+
+        unsigned length = getVectorLength(entry.type);
+        Type elementType = getElementType(entry.type);
+        for (unsigned i = 0; i < length; ++i) {
+            if (elementType == FLOAT) {
+                p[i] = v.asFloatVec()[i];
+            } else if (elementType == INT) {
+                p[i] = float(v.asIntVec()[i]);
+            } else {
+                p[i] = (v.asBoolVec()[i] ? 1.0f : 0.0f);
+            }
+        }
+    }
+
+}
@@ -0,0 +1,76 @@
+#ifndef REN_UNIFORM_LAYOUT_H
+#define REN_UNIFORM_LAYOUT_H
+
+
+#include <map>
+#include <vector>
+#include "Types.h"
+#include "Value.h"
+
+
+namespace ren {
+
+    /**
+     * Where a program's uniforms live in one array of vec4s, so the
+     * application can upload all of them with a single call.  Uniforms
+     * are aligned as in a std140 block: a vec3 or vec4 starts a new
+     * vec4, a vec2 starts on an even component, and each matrix column
+     * gets a vec4 of its own.  Samplers can't be stored in an array of
+     * vec4s, so they're left out.  Bools and ints are stored as floats.
+     */
+    class UniformLayout {
+    public:
+        /// The array's name in the generated shaders.
+        static const char* const ARRAY_NAME;
+
+        struct Entry {
+            Entry(const string& name_, Type type_, size_t offset_)
+            : name(name_)
+            , type(type_)
+            , offset(offset_) {
+            }
+
+            string name;
+            Type type;
+            size_t offset;  ///< In floats, from the start of the array.
+        };
+        typedef std::vector<Entry> EntryList;
+
+        UniformLayout()
+        : _size(0) {
+        }
+
+        static bool canPack(Type type);
+
+        /// Places a uniform after the others.  Returns false, and
+        /// doesn't place it, if it can't be packed.
+        bool add(const string& name, Type type);
+
+        /// Returns null if the uniform isn't in the array.
+        const Entry* find(const string& name) const;
+
+        const EntryList& getEntries() const {
+            return _entries;
+        }
+
+        /// Floats in the array: always a whole number of vec4s.
+        size_t getSize() const {
+            return (_size + 3) / 4 * 4;
+        }
+
+        /// GLSL expression that reads an entry out of the array.
+        static string getReference(const Entry& entry);
+
+        /// Stores a value where the layout places it.
+        static void write(float* buffer, const Entry& entry, const Value& v);
+
+    private:
+        EntryList _entries;
+        std::map<string, size_t> _indices;
+        size_t _size;
+    };
+
+}
+
+
+#endif
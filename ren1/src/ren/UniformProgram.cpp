@@ -0,0 +1,337 @@
+#include <cmath>
+#include <sstream>
+#include "UniformProgram.h"
+
+
+namespace ren {
+
+    namespace {
+
+        struct Operand {
+            Operand(const float* data_, Type type_)
+            : data(data_)
+            , type(type_)
+            , arity(getArity(type_)) {
+            }
+
+            /// Scalars broadcast across vectors.
+            float operator[](int i) const {
+                return data[arity == 1 ? 0 : i];
+            }
+
+            const float* data;
+            Type type;
+            int arity;
+        };
+        typedef std::vector<Operand> OperandList;
+
+
+        int getSwizzleIndex(char c) {
+            switch (c) {
+                case 'x': case 'r': case 's': return 0;
+                case 'y': case 'g': case 't': return 1;
+                case 'z': case 'b': case 'p': return 2;
+                case 'w': case 'a': case 'q': return 3;
+                default: return -1;
+            }
+        }
+
+
+        bool isConstructor(const string& op, Type type) {
+            return getVectorLength(type) > 1 && op == type.getName();
+        }
+
+
+        float dot(const Operand& a, const Operand& b) {
+            float rv = 0;
+            for (int i = 0; i < a.arity; ++i) {
+                rv += a[i] * b[i];
+            }
+            return rv;
+        }
+
+
+        /// GLSL matrices are column-major.
+        void multiply(const Operand& m, const Operand& v, float* r, int n) {
+            for (int row = 0; row < n; ++row) {
+                r[row] = 0;
+                for (int col = 0; col < n; ++col) {
+                    r[row] += m.data[col * n + row] * v.data[col];
+                }
+            }
+        }
+
+
+        void callInfix(const string& op, const OperandList& a,
+                       float* r, int n) {
+            if (op == "*" && isMatrix(a[0].type) && !isMatrix(a[1].type)) {
+                multiply(a[0], a[1], r, n);
+                return;
+            }
+
+            for (int i = 0; i < n; ++i) {
+                float lhs = a[0][i];
+                float rhs = a[1][i];
+                if      (op == "*") r[i] = lhs * rhs;
+                else if (op == "+") r[i] = lhs + rhs;
+                else if (op == "-") r[i] = lhs - rhs;
+                else if (op == "/") r[i] = lhs / rhs;
+                else if (op == ">") r[i] = (lhs > rhs);
+                else assert(!"Unknown infix operator");
+            }
+        }
+
+
+        void callFunction(const string& op, Type type,
+                          const OperandList& a, float* r, int n) {
+            if (isConstructor(op, type)) {
+                int k = 0;
+                for (size_t i = 0; i < a.size(); ++i) {
+                    for (int j = 0; j < a[i].arity && k < n; ++j) {
+                        r[k++] = a[i].data[j];
+                    }
+                }
+                // vec4(x) fills every component with x.
+                for (; k < n; ++k) {
+                    r[k] = r[0];
+                }
+            } else if (op == "normalize") {
+                float length = std::sqrt(dot(a[0], a[0]));
+                for (int i = 0; i < n; ++i) {
+                    r[i] = a[0][i] / length;
+                }
+            } else if (op == "reflect") {
+                // I - 2 * dot(N, I) * N
+                float d = dot(a[1], a[0]);
+                for (int i = 0; i < n; ++i) {
+                    r[i] = a[0][i] - 2 * d * a[1][i];
+                }
+            } else if (op == "dot") {
+                r[0] = dot(a[0], a[1]);
+            } else if (op == "mix") {
+                for (int i = 0; i < n; ++i) {
+                    r[i] = a[0][i] * (1 - a[2][i]) + a[1][i] * a[2][i];
+                }
+            } else {
+                for (int i = 0; i < n; ++i) {
+                    float x = a[0][i];
+                    if      (op == "fract") r[i] = x - std::floor(x);
+                    else if (op == "pow")   r[i] = std::pow(x, a[1][i]);
+                    else if (op == "max")   r[i] = std::max(x, a[1][i]);
+                    else if (op == "step")  r[i] = (a[1][i] < x ? 0 : 1);
+                    else assert(!"Unknown function");
+                }
+            }
+        }
+
+
+        void load(ValuePtr value, Type type, float* r, int n) {
+            Type elementType = getElementType(type);
+            for (int i = 0; i < n; ++i) {
+                if (elementType == FLOAT) {
+                    r[i] = value->asFloatVec()[i];
+                } else if (elementType == INT) {
+                    r[i] = float(value->asIntVec()[i]);
+                } else {
+                    r[i] = value->asBoolVec()[i];
+                }
+            }
+        }
+
+
+        ValuePtr makeValue(Type type, const float* data) {
+            Type elementType = getElementType(type);
+            int n = getArity(type);
+            if (elementType == FLOAT) {
+                return Value::create(type, data);
+            } else if (elementType == INT) {
+                int ints[16];
+                for (int i = 0; i < n; ++i) {
+                    ints[i] = int(data[i]);
+                }
+                return Value::create(type, ints);
+            } else {
+                bool bools[16];
+                for (int i = 0; i < n; ++i) {
+                    bools[i] = (data[i] != 0);
+                }
+                return Value::create(type, bools);
+            }
+        }
+
+    }
+
+
+    bool UniformProgram::canCall(CallType callType, const string& op,
+                                 Type type) {
+        if (getElementType(type) == NullType) {
+            return false;
+        }
+
+        switch (callType) {
+            case FunctionNode::SWIZZLE:
+                for (size_t i = 0; i < op.size(); ++i) {
+                    if (getSwizzleIndex(op[i]) < 0) {
+                        return false;
+                    }
+                }
+                return !op.empty() && op.size() <= 4;
+
+            case FunctionNode::INFIX:
+                return op == "*" || op == "+" || op == "-" || op == "/" ||
+                       op == ">";
+
+            case FunctionNode::PREFIX:
+                return op == "+" || op == "-";
+
+            case FunctionNode::FUNCTION:
+                return isConstructor(op, type) ||
+                       op == "normalize" || op == "reflect" ||
+                       op == "dot"       || op == "mix"     ||
+                       op == "fract"     || op == "pow"     ||
+                       op == "max"       || op == "step";
+
+            default:
+                return false;
+        }
+    }
+
+
+    UniformProgram::UniformProgram()
+    : _scratchSize(0) {
+    }
+
+
+    size_t UniformProgram::addInstruction(const Instruction& instruction) {
+        for (size_t i = 0; i < instruction.arguments.size(); ++i) {
+            assert(instruction.arguments[i] < _instructions.size());
+        }
+        _instructions.push_back(instruction);
+        _offsets.push_back(_scratchSize);
+        _scratchSize += getArity(instruction.type);
+        return _instructions.size() - 1;
+    }
+
+
+    void UniformProgram::addOutput(const string& name, size_t instruction) {
+        assert(instruction < _instructions.size());
+        Output o;
+        o.name = name;
+        o.instruction = instruction;
+        _outputs.push_back(o);
+    }
+
+
+    std::vector<string> UniformProgram::getInputs() const {
+        std::vector<string> rv;
+        for (size_t i = 0; i < _instructions.size(); ++i) {
+            if (_instructions[i].opcode == LOAD_UNIFORM) {
+                rv.push_back(_instructions[i].name);
+            }
+        }
+        return rv;
+    }
+
+
+    void UniformProgram::evaluate(
+        const ValueMap& uniforms,
+        ValueMap& outputs
+    ) const {
+        std::vector<float> scratch(_scratchSize);
+
+        for (size_t i = 0; i < _instructions.size(); ++i) {
+            const Instruction& in = _instructions[i];
+            float* r = &scratch[_offsets[i]];
+            int n = getArity(in.type);
+
+            OperandList a;
+            for (size_t j = 0; j < in.arguments.size(); ++j) {
+                size_t k = in.arguments[j];
+                a.push_back(Operand(&scratch[_offsets[k]],
+                                    _instructions[k].type));
+            }
+
+            switch (in.opcode) {
+                case LOAD_UNIFORM: {
+                    ValueMap::const_iterator u = uniforms.find(in.name);
+                    if (u != uniforms.end()) {
+                        load(u->second, in.type, r, n);
+                    }
+                    break;
+                }
+
+                case LOAD_CONSTANT:
+                    load(in.value, in.type, r, n);
+                    break;
+
+                case CALL:
+                    switch (in.callType) {
+                        case FunctionNode::SWIZZLE:
+                            for (int j = 0; j < n; ++j) {
+                                r[j] = a[0].data[getSwizzleIndex(in.name[j])];
+                            }
+                            break;
+
+                        case FunctionNode::INFIX:
+                            callInfix(in.name, a, r, n);
+                            break;
+
+                        case FunctionNode::PREFIX:
+                            for (int j = 0; j < n; ++j) {
+                                r[j] = (in.name == "-" ? -a[0][j] : a[0][j]);
+                            }
+                            break;
+
+                        case FunctionNode::FUNCTION:
+                            callFunction(in.name, in.type, a, r, n);
+                            break;
+
+                        default:
+                            assert(!"Unknown call type");
+                    }
+                    break;
+
+                case SELECT: {
+                    const Operand& from = (a[0][0] != 0 ? a[1] : a[2]);
+                    std::copy(from.data, from.data + n, r);
+                    break;
+                }
+
+                default:
+                    assert(!"Unknown opcode");
+            }
+        }
+
+        for (size_t i = 0; i < _outputs.size(); ++i) {
+            size_t k = _outputs[i].instruction;
+            outputs[_outputs[i].name] = makeValue(_instructions[k].type,
+                                                  &scratch[_offsets[k]]);
+        }
+    }
+
+
+    string UniformProgram::asString() const {
+        std::ostringstream os;
+        for (size_t i = 0; i < _instructions.size(); ++i) {
+            const Instruction& in = _instructions[i];
+            os << "%" << i << " = " << in.type.getName() << " ";
+            switch (in.opcode) {
+                case LOAD_UNIFORM:  os << "uniform " << in.name; break;
+                case LOAD_CONSTANT: os << in.value->asString();  break;
+                case CALL:          os << in.name;               break;
+                case SELECT:        os << "select";              break;
+                default:            assert(!"Unknown opcode");
+            }
+            for (size_t j = 0; j < in.arguments.size(); ++j) {
+                os << " %" << in.arguments[j];
+            }
+            os << "\n";
+        }
+        for (size_t i = 0; i < _outputs.size(); ++i) {
+            os << _outputs[i].name << " = %" << _outputs[i].instruction
+               << "\n";
+        }
+        return os.str();
+    }
+
+}
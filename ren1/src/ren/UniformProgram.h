@@ -0,0 +1,100 @@
+#ifndef REN_UNIFORM_PROGRAM_H
+#define REN_UNIFORM_PROGRAM_H
+
+
+#include <map>
+#include <vector>
+#include "ConcreteNode.h"
+#include "Types.h"
+#include "Value.h"
+
+
+namespace ren {
+
+    /**
+     * Computes derived uniforms on the CPU.  When the compiler hoists
+     * a subexpression that depends only on uniforms and constants out
+     * of the shaders, the shaders read its result from a new uniform,
+     * and this program computes that uniform's value from the ones the
+     * application sets, once per draw instead of once per vertex or
+     * pixel.
+     *
+     * Instructions are in order, and each reads the results of earlier
+     * ones.
+     */
+    class UniformProgram {
+    public:
+        typedef FunctionNode::CallType CallType;
+
+        enum Opcode {
+            LOAD_UNIFORM,   ///< The application's uniform called name.
+            LOAD_CONSTANT,  ///< value.
+            CALL,           ///< The built-in op, as in GLSL.
+            SELECT,         ///< arguments[0] ? arguments[1] : arguments[2]
+        };
+
+        struct Instruction {
+            Instruction(Opcode opcode_, Type type_)
+            : opcode(opcode_)
+            , type(type_)
+            , callType(FunctionNode::FUNCTION) {
+            }
+
+            Opcode opcode;
+            Type type;
+            CallType callType;
+            string name;
+            ValuePtr value;
+            std::vector<size_t> arguments;
+        };
+
+        struct Output {
+            string name;
+            size_t instruction;
+        };
+
+        typedef std::map<string, ValuePtr> ValueMap;
+
+        /// Can CALL instructions evaluate this built-in?
+        static bool canCall(CallType callType, const string& op, Type type);
+
+        UniformProgram();
+
+        /// Returns the new instruction's index.
+        size_t addInstruction(const Instruction& instruction);
+        void addOutput(const string& name, size_t instruction);
+
+        const std::vector<Instruction>& getInstructions() const {
+            return _instructions;
+        }
+
+        const std::vector<Output>& getOutputs() const {
+            return _outputs;
+        }
+
+        /// The application's uniforms the program reads.
+        std::vector<string> getInputs() const;
+
+        /**
+         * Computes every output from uniforms.  Uniforms that aren't
+         * given read as zero, as they would in GLSL.
+         */
+        void evaluate(const ValueMap& uniforms, ValueMap& outputs) const;
+
+        /// One line per instruction, for debugging.
+        string asString() const;
+
+    private:
+        std::vector<Instruction> _instructions;
+        std::vector<Output> _outputs;
+
+        /// Where each instruction's result starts in the scratch space.
+        std::vector<size_t> _offsets;
+        size_t _scratchSize;
+    };
+    REN_SHARED_PTR(UniformProgram);
+
+}
+
+
+#endif
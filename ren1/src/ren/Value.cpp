@@ -0,0 +1,8 @@
+#include "Value.h"
+
+
+namespace ren {
+
+    const ValuePtr NullValue;
+
+}
@@ -115,11 +115,16 @@ namespace ren {
         Value(Type type, const T* data)
         : _type(type) {
             TypeChecker<T>::check(type);
-            if (!data) {
-                static T empty[maxArity];
-                data = empty;
+            T* storage = getStorage<T>();
+            if (data) {
+                std::copy(data, data + getArity(type), storage);
+            } else {
+                std::fill(storage, storage + getArity(type), T());
             }
-            std::copy(data, data + getArity(type), getStorage<T>());
+        }
+
+        Type getType() const {
+            return _type;
         }
 
         bool asBool() const {
@@ -237,7 +242,8 @@ namespace ren {
     };
 
 
-    static ValuePtr NullValue;
+    /// No value, as for inputs that aren't constants.
+    extern const ValuePtr NullValue;
 
 };
 
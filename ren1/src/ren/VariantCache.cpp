@@ -0,0 +1,244 @@
+#include <algorithm>
+#include "VariantCache.h"
+
+
+namespace ren {
+
+    namespace {
+
+        bool lessThan(
+            const UniformLayout::Entry& lhs,
+            const UniformLayout::Entry& rhs
+        ) {
+            if (lhs.name != rhs.name) {
+                return lhs.name < rhs.name;
+            }
+            if (lhs.type != rhs.type) {
+                return lhs.type < rhs.type;
+            }
+            return lhs.offset < rhs.offset;
+        }
+
+    }
+
+
+    bool VariantCache::ResultKey::operator<(const ResultKey& rhs) const {
+        if (serial != rhs.serial) {
+            return serial < rhs.serial;
+        }
+        if (result->success != rhs.result->success) {
+            return result->success < rhs.result->success;
+        }
+        if (result->vertexShader != rhs.result->vertexShader) {
+            return result->vertexShader < rhs.result->vertexShader;
+        }
+        if (result->fragmentShader != rhs.result->fragmentShader) {
+            return result->fragmentShader < rhs.result->fragmentShader;
+        }
+
+        const UniformLayout::EntryList& a =
+            result->uniformLayout.getEntries();
+        const UniformLayout::EntryList& b =
+            rhs.result->uniformLayout.getEntries();
+        return std::lexicographical_compare(
+            a.begin(), a.end(), b.begin(), b.end(), lessThan);
+    }
+
+
+    VariantCache::VariantCache(size_t budget, const CompileOptions& options)
+    : _budget(budget)
+    , _options(options)
+    , _serial(0)
+    , _bytesUsed(0)
+    , _hits(0)
+    , _misses(0)
+    , _evictions(0) {
+    }
+
+
+    CompileResultPtr VariantCache::get(
+        ProgramPtr program,
+        std::ostream& output
+    ) {
+        collect(output);
+
+        VariantKey key(program.get(), program->getPermutationKey());
+        CompileResultPtr rv = find(key, program);
+        if (rv) {
+            return rv;
+        }
+
+        PendingMap::iterator p = _pending.find(key);
+        if (p != _pending.end() && p->second.program.lock() == program) {
+            // Waiting for it is no slower than compiling it again.
+            PendingCompilePtr pending = p->second.compile;
+            _pending.erase(p);
+            CompileResultPtr cr = pending->wait();
+            output << pending->getOutput();
+            return insert(key, program, *cr);
+        }
+
+        ++_misses;
+        return insert(key, program, compile(program, _options, output));
+    }
+
+
+    CompileResultPtr VariantCache::getAsync(
+        ProgramPtr program,
+        CompileQueue& queue,
+        std::ostream& output
+    ) {
+        collect(output);
+
+        VariantKey key(program.get(), program->getPermutationKey());
+        CompileResultPtr rv = find(key, program);
+        if (rv) {
+            return rv;
+        }
+
+        PendingMap::iterator p = _pending.find(key);
+        if (p == _pending.end() || p->second.program.lock() != program) {
+            ++_misses;
+            Pending pending;
+            pending.program = program;
+            pending.compile = queue.compileAsync(program, _options);
+            _pending[key] = pending;
+        }
+        return rv;
+    }
+
+
+    bool VariantCache::isPending(ProgramPtr program) const {
+        PendingMap::const_iterator i = _pending.find(
+            VariantKey(program.get(), program->getPermutationKey()));
+        return i != _pending.end() && i->second.program.lock() == program &&
+               !i->second.compile->isReady();
+    }
+
+
+    void VariantCache::clear() {
+        _variants.clear();
+        _results.clear();
+        _lru.clear();
+        _pending.clear();
+        _bytesUsed = 0;
+    }
+
+
+    void VariantCache::setBudget(size_t budget) {
+        _budget = budget;
+        evict();
+    }
+
+
+    CompileResultPtr VariantCache::find(
+        const VariantKey& key,
+        ProgramPtr program
+    ) {
+        VariantMap::iterator i = _variants.find(key);
+        if (i == _variants.end()) {
+            return CompileResultPtr();
+        }
+
+        if (i->second.program.lock() != program) {
+            // A new program where a destroyed one used to be.
+            erase(i);
+            return CompileResultPtr();
+        }
+
+        ++_hits;
+        _lru.splice(_lru.begin(), _lru, i->second.lru);
+        return i->second.result->second.result;
+    }
+
+
+    CompileResultPtr VariantCache::insert(
+        const VariantKey& key,
+        ProgramPtr program,
+        const CompileResult& cr
+    ) {
+        VariantMap::iterator i = _variants.find(key);
+        if (i != _variants.end()) {
+            erase(i);
+        }
+
+        Variant v;
+        v.program = program;
+        v.result = addResult(cr);
+        v.lru = _lru.insert(_lru.begin(), key);
+        _variants.insert(VariantMap::value_type(key, v));
+
+        CompileResultPtr rv = v.result->second.result;
+        evict();
+        return rv;
+    }
+
+
+    void VariantCache::collect(std::ostream& output) {
+        PendingMap::iterator i = _pending.begin();
+        while (i != _pending.end()) {
+            if (!i->second.compile->isReady()) {
+                ++i;
+                continue;
+            }
+
+            // Compiles for destroyed programs are dropped.
+            ProgramPtr program = i->second.program.lock();
+            if (program) {
+                output << i->second.compile->getOutput();
+                insert(i->first, program, *i->second.compile->getResult());
+            }
+            _pending.erase(i++);
+        }
+    }
+
+
+    VariantCache::ResultMap::iterator VariantCache::addResult(
+        const CompileResult& cr
+    ) {
+        ResultMap::iterator i = _results.end();
+        if (!cr.uniformProgram) {
+            i = _results.find(ResultKey(&cr, 0));
+        }
+
+        if (i == _results.end()) {
+            Result r;
+            r.result.reset(new CompileResult(cr));
+            r.bytes = sizeof(CompileResult) + sizeof(Result)
+                + cr.vertexShader.size() + cr.fragmentShader.size();
+            r.users = 0;
+
+            size_t serial = (cr.uniformProgram ? ++_serial : 0);
+            i = _results.insert(ResultMap::value_type(
+                ResultKey(r.result.get(), serial), r)).first;
+            _bytesUsed += r.bytes;
+        }
+
+        ++i->second.users;
+        return i;
+    }
+
+
+    void VariantCache::erase(VariantMap::iterator i) {
+        ResultMap::iterator r = i->second.result;
+        if (--r->second.users == 0) {
+            _bytesUsed -= r->second.bytes;
+            _results.erase(r);
+        }
+        _lru.erase(i->second.lru);
+        _variants.erase(i);
+    }
+
+
+    void VariantCache::evict() {
+        // The most recently used variant stays, even if it alone is
+        // over the budget: it's about to be drawn with.
+        while (_bytesUsed > _budget && _lru.size() > 1) {
+            VariantMap::iterator i = _variants.find(_lru.back());
+            assert(i != _variants.end());
+            erase(i);
+            ++_evictions;
+        }
+    }
+
+}
@@ -0,0 +1,182 @@
+#ifndef REN_VARIANT_CACHE_H
+#define REN_VARIANT_CACHE_H
+
+
+#include <iostream>
+#include <list>
+#include <map>
+#include <boost/noncopyable.hpp>
+#include <boost/weak_ptr.hpp>
+#include "CompileQueue.h"
+#include "Compiler.h"
+#include "PermutationKey.h"
+#include "Program.h"
+
+
+namespace ren {
+
+    /**
+     * The shaders compiled for each combination of constant values
+     * programs have been used with, so each combination is compiled
+     * once.  Constant sets that compile to identical shaders share one
+     * result.  Once the results take more memory than the budget, the
+     * least recently used ones are dropped.
+     *
+     * Programs are told apart by identity, and the cache doesn't keep
+     * them alive.  Failed compiles are cached too, so their errors
+     * are only written once.
+     *
+     * Compiles can also run on a CompileQueue.  Their results enter
+     * the cache, under the same budget, when they finish.  Use the
+     * cache from one thread.
+     */
+    class VariantCache : public boost::noncopyable {
+    public:
+        explicit VariantCache(
+            size_t budget = 16 * 1024 * 1024,
+            const CompileOptions& options = CompileOptions());
+
+        /// The result for the program's current constant values.
+        /// Compiles them, writing errors to output, if they aren't
+        /// cached, or waits for them if they're queued.
+        CompileResultPtr get(
+            ProgramPtr program,
+            std::ostream& output = std::cerr);
+
+        /**
+         * Like get(), but never waits: if the program's current
+         * constant values aren't cached, queues them, unless they're
+         * queued already, and returns null.  Writes what finished
+         * compiles wrote to output.
+         */
+        CompileResultPtr getAsync(
+            ProgramPtr program,
+            CompileQueue& queue,
+            std::ostream& output = std::cerr);
+
+        /// Whether the program's current constant values are queued
+        /// and not finished.
+        bool isPending(ProgramPtr program) const;
+
+        /// Drops the cached results, and the results of compiles still
+        /// queued.
+        void clear();
+
+        size_t getBudget() const {
+            return _budget;
+        }
+
+        /// Evicts results until they fit.
+        void setBudget(size_t budget);
+
+        /// Compiles queued by getAsync() that haven't been collected.
+        size_t getPendingCount() const {
+            return _pending.size();
+        }
+
+        /// Constant sets cached, over all programs.
+        size_t getVariantCount() const {
+            return _variants.size();
+        }
+
+        /// Distinct results cached.
+        size_t getResultCount() const {
+            return _results.size();
+        }
+
+        /// Roughly the memory the results take: their shaders' text,
+        /// and some overhead for each.
+        size_t getBytesUsed() const {
+            return _bytesUsed;
+        }
+
+        size_t getHits() const {
+            return _hits;
+        }
+
+        size_t getMisses() const {
+            return _misses;
+        }
+
+        size_t getEvictions() const {
+            return _evictions;
+        }
+
+    private:
+        typedef std::pair<const Program*, PermutationKey> VariantKey;
+        typedef std::list<VariantKey> LRUList;
+
+        /**
+         * Orders results by everything they tell the application:
+         * whether they succeeded, their shaders' text, and where their
+         * packed uniforms are.  A uniform program can fold in
+         * constants the shaders don't show, so results with one are
+         * never shared: they get a unique serial number.
+         */
+        struct ResultKey {
+            ResultKey(const CompileResult* result_, size_t serial_)
+            : result(result_)
+            , serial(serial_) {
+            }
+
+            bool operator<(const ResultKey& rhs) const;
+
+            const CompileResult* result;
+            size_t serial;
+        };
+
+        struct Result {
+            CompileResultPtr result;
+            size_t bytes;
+            size_t users;
+        };
+        typedef std::map<ResultKey, Result> ResultMap;
+
+        struct Variant {
+            boost::weak_ptr<Program> program;
+            ResultMap::iterator result;
+            LRUList::iterator lru;
+        };
+        typedef std::map<VariantKey, Variant> VariantMap;
+
+        struct Pending {
+            boost::weak_ptr<Program> program;
+            PendingCompilePtr compile;
+        };
+        typedef std::map<VariantKey, Pending> PendingMap;
+
+        /// The cached variant for key, if program is still the one
+        /// it was compiled for.  Counts a hit.
+        CompileResultPtr find(const VariantKey& key, ProgramPtr program);
+
+        CompileResultPtr insert(
+            const VariantKey& key,
+            ProgramPtr program,
+            const CompileResult& cr);
+
+        /// Moves finished compiles into the cache.
+        void collect(std::ostream& output);
+
+        ResultMap::iterator addResult(const CompileResult& cr);
+        void erase(VariantMap::iterator i);
+        void evict();
+
+        size_t _budget;
+        CompileOptions _options;
+
+        VariantMap _variants;
+        ResultMap _results;
+        LRUList _lru;  ///< Most recently used first.
+        PendingMap _pending;
+
+        size_t _serial;
+        size_t _bytesUsed;
+        size_t _hits;
+        size_t _misses;
+        size_t _evictions;
+    };
+
+}
+
+
+#endif
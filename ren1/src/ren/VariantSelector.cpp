@@ -0,0 +1,45 @@
+#include "VariantSelector.h"
+
+
+namespace ren {
+
+    VariantSelector::VariantSelector(
+        ProgramPtr program,
+        VariantCache& cache,
+        CompileQueue& queue
+    )
+    : _program(program)
+    , _cache(cache)
+    , _queue(queue) {
+    }
+
+
+    bool VariantSelector::setFallback(std::ostream& output) {
+        CompileResultPtr r = _cache.get(_program, output);
+        if (!r->success) {
+            return false;
+        }
+        _current = r;
+        _currentKey = _program->getPermutationKey();
+        return true;
+    }
+
+
+    CompileResultPtr VariantSelector::get(std::ostream& output) {
+        CompileResultPtr r = _cache.getAsync(_program, _queue, output);
+
+        // Failed variants stay cached, so they aren't compiled again,
+        // but are never drawn with.
+        if (r && r->success) {
+            _current = r;
+            _currentKey = _program->getPermutationKey();
+        }
+        return _current;
+    }
+
+
+    bool VariantSelector::isPending() const {
+        return _cache.isPending(_program);
+    }
+
+}
@@ -0,0 +1,68 @@
+#ifndef REN_VARIANT_SELECTOR_H
+#define REN_VARIANT_SELECTOR_H
+
+
+#include <iostream>
+#include <boost/noncopyable.hpp>
+#include "CompileQueue.h"
+#include "PermutationKey.h"
+#include "Program.h"
+#include "VariantCache.h"
+
+
+namespace ren {
+
+    /**
+     * Picks the shaders to draw a program with, without ever waiting
+     * for a compile.  When the program's constants change to values
+     * that haven't been compiled, they're queued, and the last variant
+     * that compiled successfully is used until they're done.  Before
+     * any is, the fallback is.
+     *
+     * Variants are kept in a VariantCache, which several selectors
+     * can share, so each is compiled once while it stays cached.  Use
+     * it from the cache's thread: the one that draws.
+     */
+    class VariantSelector : public boost::noncopyable {
+    public:
+        /// Compiles with the cache's options.
+        VariantSelector(
+            ProgramPtr program,
+            VariantCache& cache,
+            CompileQueue& queue);
+
+        /// Compiles the program's current constant values right away,
+        /// and uses them until another variant is ready.  Returns
+        /// whether they compiled.
+        bool setFallback(std::ostream& output = std::cerr);
+
+        /**
+         * The result to draw with for the program's current constant
+         * values, queueing them if they aren't cached.  Writes what
+         * finished compiles wrote to their output.  Null if nothing
+         * has compiled successfully yet.
+         */
+        CompileResultPtr get(std::ostream& output = std::cerr);
+
+        /// Identifies the variant get() last returned.
+        const PermutationKey& getKey() const {
+            return _currentKey;
+        }
+
+        /// Whether the program's current constant values are still
+        /// compiling.
+        bool isPending() const;
+
+    private:
+        ProgramPtr _program;
+        VariantCache& _cache;
+        CompileQueue& _queue;
+
+        CompileResultPtr _current;
+        PermutationKey _currentKey;
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,32 @@
+#include "TestPrologue.h"
+
+
+TEST(Arena) {
+    Arena arena;
+    {
+        ArenaScope scope(arena);
+        CHECK(Arena::getCurrent() == &arena);
+
+        CodeNodePtr a(new NameCodeNode(
+                          "a", FLOAT, UNIFORM, NullValue,
+                          ValueNode::UNIFORM));
+        CHECK_EQUAL(arena.getAllocationCount(), 1U);
+
+        // A released block is reused for the next node of its size.
+        NameCodeNode* first = static_cast<NameCodeNode*>(a.get());
+        a.reset();
+        a.reset(new NameCodeNode(
+                    "b", FLOAT, UNIFORM, NullValue,
+                    ValueNode::UNIFORM));
+        CHECK(a.get() == first);
+        CHECK_EQUAL(arena.getAllocationCount(), 2U);
+        CHECK(arena.getBytesUsed() <= arena.getBytesReserved());
+    }
+    CHECK(Arena::getCurrent() == 0);
+
+    // Without a current arena, nodes come from the heap.
+    CodeNodePtr c(new NameCodeNode(
+                      "c", FLOAT, UNIFORM, NullValue,
+                      ValueNode::UNIFORM));
+    CHECK_EQUAL(arena.getAllocationCount(), 2U);
+}
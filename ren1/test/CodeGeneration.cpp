@@ -21,3 +21,33 @@ TEST(ReferenceGeneration) {
     CHECK_EQUAL(cr.vertexShader, ref_vs);
     CHECK_EQUAL(cr.fragmentShader, ref_fs);
 }
+
+
+TEST(SinkGeneration) {
+    string vs, fs;
+    StringSink vsSink(vs);
+    StringSink fsSink(fs);
+    CompileResult cr = compile(parse(ref_source), vsSink, fsSink);
+    CHECK(cr.success);
+    CHECK_EQUAL(vs, ref_vs);
+    CHECK_EQUAL(fs, ref_fs);
+    CHECK_EQUAL(cr.vertexShader, "");
+}
+
+
+TEST(LongExpression) {
+    // Longer than the writer's buffer, so it's flushed midway.
+    CodeNodePtr x(new NameCodeNode("x", FLOAT, UNIFORM, NullValue,
+                                   ValueNode::UNIFORM));
+    string expected = "x";
+    for (size_t i = 0; i < 1000; ++i) {
+        CodeNodeList args(2);
+        args[0] = x;
+        args[1] = CodeNodePtr(new NameCodeNode("y", FLOAT, UNIFORM, NullValue,
+                                               ValueNode::UNIFORM));
+        x.reset(new CallCodeNode(FLOAT, FunctionNode::INFIX, "+", args,
+                                 LINEAR));
+        expected = "(" + expected + " + y)";
+    }
+    CHECK_EQUAL(x->asExpression(), expected);
+}
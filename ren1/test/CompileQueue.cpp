@@ -0,0 +1,124 @@
+#include <boost/bind.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/thread/mutex.hpp>
+#include <ren/CompileQueue.h>
+#include <ren/VariantCache.h>
+#include <ren/VariantSelector.h>
+#include "TestPrologue.h"
+
+
+static const string source =
+    "constant bool Transform\n"
+    "foo = ftransform\n"
+    "bar = gl_ModelViewProjectionMatrix * gl_Vertex\n"
+    "gl_Position = if Transform then foo else bar\n"
+    ;
+
+static const string VStrue =
+    "void main()\n"
+    "{\n"
+    "  gl_Position = ftransform();\n"
+    "}\n"
+    ;
+
+static const string VSfalse =
+    "void main()\n"
+    "{\n"
+    "  gl_Position = (gl_ModelViewProjectionMatrix * gl_Vertex);\n"
+    "}\n"
+    ;
+
+
+static void countCompile(size_t* count, const CompileResult&, const string&) {
+    ++*count;
+}
+
+
+TEST(CompileAsync) {
+    ProgramPtr p = parse(source);
+    CHECK(p);
+    Bool transform(p, "Transform");
+
+    size_t callbacks = 0;
+    CompileQueue queue(2);
+    transform = true;
+    PendingCompilePtr a = queue.compileAsync(
+        p, CompileOptions(), boost::bind(countCompile, &callbacks, _1, _2));
+
+    // The values were copied when the compile was queued.
+    transform = false;
+    PendingCompilePtr b = queue.compileAsync(p);
+
+    CHECK_EQUAL(a->wait()->vertexShader, VStrue);
+    CHECK_EQUAL(b->wait()->vertexShader, VSfalse);
+    CHECK(a->isReady());
+    CHECK_EQUAL(callbacks, 1u);
+}
+
+
+/// Keeps a queue's only thread busy until released.
+class Blocker {
+public:
+    Blocker()
+    : _released(false) {
+    }
+
+    void block(const CompileResult&, const string&) {
+        boost::mutex::scoped_lock lock(_mutex);
+        while (!_released) {
+            _changed.wait(lock);
+        }
+    }
+
+    void release() {
+        boost::mutex::scoped_lock lock(_mutex);
+        _released = true;
+        _changed.notify_all();
+    }
+
+private:
+    boost::mutex _mutex;
+    boost::condition _changed;
+    bool _released;
+};
+
+
+TEST(VariantSelector) {
+    ProgramPtr p = parse(source);
+    CHECK(p);
+    Bool transform(p, "Transform");
+
+    CompileQueue queue(1);
+    VariantCache cache;
+    VariantSelector selector(p, cache, queue);
+
+    CHECK(selector.setFallback());
+    CompileResultPtr fallback = selector.get();
+    CHECK(fallback);
+    CHECK_EQUAL(fallback->vertexShader, VSfalse);
+
+    Blocker blocker;
+    queue.compileAsync(
+        p, CompileOptions(), boost::bind(&Blocker::block, &blocker, _1, _2));
+
+    // The fallback is used until the new variant is ready.
+    transform = true;
+    CHECK(selector.get() == fallback);
+    CHECK(selector.isPending());
+    CHECK(selector.getKey() != p->getPermutationKey());
+
+    blocker.release();
+    while (selector.isPending()) {
+        boost::thread::yield();
+    }
+    CompileResultPtr r = selector.get();
+    CHECK_EQUAL(r->vertexShader, VStrue);
+    CHECK(selector.getKey() == p->getPermutationKey());
+
+    // Switching back doesn't compile again.
+    transform = false;
+    CHECK(selector.get() == fallback);
+    CHECK(!selector.isPending());
+    CHECK_EQUAL(cache.getMisses(), 2u);
+    CHECK_EQUAL(cache.getVariantCount(), 2u);
+}
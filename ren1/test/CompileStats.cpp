@@ -0,0 +1,46 @@
+#include <sstream>
+#include "TestPrologue.h"
+
+
+TEST(CompileStats) {
+    string source =
+        "uniform float scale\n"
+        "gl_Position = ftransform\n"
+        "gl_FragColor = gl_Color * scale\n"
+        ;
+
+    CompileStats stats;
+    CompileResult cr = compile(source, std::cerr, &stats);
+    CHECK(cr.success);
+    CHECK_EQUAL(stats.compiles, 1U);
+    CHECK_EQUAL(stats.varyings, 1U);
+    CHECK_EQUAL(stats.uniforms, 1U);
+    CHECK_EQUAL(stats.constants, 0U);
+    CHECK(stats.nodes[CompileStats::EVALUATE] > 0);
+
+    // Stats add up across compiles.
+    CompileStats once = stats;
+    compile(source, std::cerr, &stats);
+    CHECK_EQUAL(stats.compiles, 2U);
+    CHECK_EQUAL(stats.varyings, 2U);
+    CHECK_EQUAL(stats.nodes[CompileStats::EVALUATE],
+                2 * once.nodes[CompileStats::EVALUATE]);
+
+    once += once;
+    CHECK_EQUAL(once.uniforms, stats.uniforms);
+}
+
+
+TEST(CompileStatsFromStream) {
+    std::istringstream is(
+        "uniform float scale\n"
+        "gl_Position = ftransform * scale\n"
+        );
+
+    CompileStats stats;
+    CompileResult cr = compile(is, std::cerr, &stats);
+    CHECK(cr.success);
+    CHECK_EQUAL(stats.compiles, 1U);
+    CHECK_EQUAL(stats.uniforms, 1U);
+    CHECK(stats.nodes[CompileStats::EVALUATE] > 0);
+}
@@ -23,3 +23,29 @@ TEST(Constant) {
 
     CHECK_COMPILE(source, VS, FS);
 }
+
+
+TEST(PermutationKey) {
+    string source =
+        "constant bool Shadows\n"
+        "constant vec2 Detail\n"
+        "gl_Position = if Shadows then ftransform else (Detail ++ Detail)\n"
+        ;
+
+    ProgramPtr a = parse(source);
+    ProgramPtr b = parse(source);
+    CHECK(a && b);
+    CHECK(a->getPermutationKey() == b->getPermutationKey());
+
+    Bool shadows(a, "Shadows");
+    shadows = true;
+    CHECK(a->getPermutationKey() != b->getPermutationKey());
+    shadows = false;
+    CHECK(a->getPermutationKey() == b->getPermutationKey());
+
+    Vec2 detail(b, "Detail");
+    detail.set(0.5f, 0);
+    CHECK(a->getPermutationKey() != b->getPermutationKey());
+    CHECK(a->getPermutationKey() < b->getPermutationKey() ||
+          b->getPermutationKey() < a->getPermutationKey());
+}
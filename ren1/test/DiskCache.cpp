@@ -0,0 +1,159 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+#include <cstdlib>
+#include <fstream>
+#include <ren/DiskCache.h>
+#include "TestPrologue.h"
+
+
+/// A new, empty directory, removed with everything in it however the
+/// test ends.
+class TemporaryDirectory {
+public:
+    TemporaryDirectory() {
+#ifdef _WIN32
+        char dir[MAX_PATH];
+        char path[MAX_PATH];
+        GetTempPathA(MAX_PATH, dir);
+        GetTempFileNameA(dir, "ren", 0, path);
+        DeleteFileA(path);
+        CreateDirectoryA(path, 0);
+        _path = path;
+#else
+        const char* dir = getenv("TMPDIR");
+        string path = string(dir ? dir : "/tmp") + "/renXXXXXX";
+        if (mkdtemp(&path[0])) {
+            _path = path;
+        }
+#endif
+    }
+
+    ~TemporaryDirectory() {
+        if (_path.empty()) {
+            return;
+        }
+#ifdef _WIN32
+        WIN32_FIND_DATAA data;
+        HANDLE find = FindFirstFileA((_path + "\\*").c_str(), &data);
+        if (find != INVALID_HANDLE_VALUE) {
+            do {
+                DeleteFileA((_path + "\\" + data.cFileName).c_str());
+            } while (FindNextFileA(find, &data));
+            FindClose(find);
+        }
+        RemoveDirectoryA(_path.c_str());
+#else
+        if (DIR* dir = opendir(_path.c_str())) {
+            while (dirent* entry = readdir(dir)) {
+                string name = entry->d_name;
+                if (name != "." && name != "..") {
+                    unlink((_path + "/" + name).c_str());
+                }
+            }
+            closedir(dir);
+        }
+        rmdir(_path.c_str());
+#endif
+    }
+
+    /// Empty if the directory couldn't be made.
+    const string& getPath() const {
+        return _path;
+    }
+
+private:
+    string _path;
+};
+
+
+static const string source =
+    "constant bool Transform\n"
+    "foo = ftransform\n"
+    "bar = gl_ModelViewProjectionMatrix * gl_Vertex\n"
+    "gl_Position = if Transform then foo else bar\n"
+    ;
+
+
+static DiskCache::ConstantMap getConstants(bool transform) {
+    DiskCache::ConstantMap constants;
+    constants["Transform"] = Value::create(BOOL, &transform);
+    return constants;
+}
+
+
+TEST(DiskCache) {
+    TemporaryDirectory directory;
+    CHECK(!directory.getPath().empty());
+
+    DiskCache::ConstantMap constants = getConstants(true);
+    string path;
+    {
+        DiskCache cache(directory.getPath());
+        path = cache.getPath(source, constants);
+
+        CompileResult cr = cache.compile(source, constants);
+        CHECK(cr.success);
+        CHECK_EQUAL(cr.vertexShader,
+                    "void main()\n"
+                    "{\n"
+                    "  gl_Position = ftransform();\n"
+                    "}\n");
+        CHECK_EQUAL(cache.getMisses(), 1u);
+    }
+
+    // A later run loads what the first one compiled.
+    DiskCache cache(directory.getPath());
+    CompileResult cr = cache.compile(source, constants);
+    CHECK(cr.success);
+    CHECK_EQUAL(cr.vertexShader,
+                "void main()\n"
+                "{\n"
+                "  gl_Position = ftransform();\n"
+                "}\n");
+    CHECK_EQUAL(cache.getHits(), 1u);
+
+    CHECK(cache.getPath(source, getConstants(false)) != path);
+
+    // A damaged file is compiled again, and replaced.
+    {
+        std::ofstream os(path.c_str(), std::ios::binary | std::ios::app);
+        os << "garbage";
+    }
+    CHECK(cache.compile(source, constants).success);
+    CHECK_EQUAL(cache.getMisses(), 1u);
+    CHECK(cache.compile(source, constants).success);
+    CHECK_EQUAL(cache.getHits(), 2u);
+}
+
+
+TEST(DiskCacheConstantOverrides) {
+    TemporaryDirectory directory;
+    CHECK(!directory.getPath().empty());
+
+    // Constants given to compile() override the options' ones, both
+    // in what's compiled and in where it's saved.
+    CompileOptions options;
+    options.constants = getConstants(false);
+    DiskCache cache(directory.getPath(), options);
+
+    for (int pass = 0; pass < 2; ++pass) {
+        CompileResult cr = cache.compile(source, getConstants(true));
+        CHECK(cr.success);
+        CHECK_EQUAL(cr.vertexShader,
+                    "void main()\n"
+                    "{\n"
+                    "  gl_Position = ftransform();\n"
+                    "}\n");
+    }
+    CHECK_EQUAL(cache.getHits(), 1u);
+
+    DiskCache plain(directory.getPath());
+    CHECK_EQUAL(plain.getPath(source, getConstants(true)),
+                cache.getPath(source, getConstants(true)));
+    CHECK(cache.getPath(source, getConstants(true)) !=
+          cache.getPath(source, DiskCache::ConstantMap()));
+}
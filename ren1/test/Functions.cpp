@@ -38,6 +38,26 @@ TEST(Function) {
     CHECK_EQUAL(cc.instantiate("gl_Position")->getType(), VEC4);
 }
 
+static const string overloads =
+    "f = 1.0\n"
+    "f x = x\n"
+    "f x y = x + y\n"
+    "f = 2.0\n"
+    ;
+
+TEST(DefinitionLookup) {
+    ProgramPtr p = parse(overloads);
+    CHECK(p);
+    CHECK_EQUAL(p->getDefinitions().size(), 4U);
+
+    // Definitions are found by name and arity; the first one wins.
+    CHECK_EQUAL(p->getDefinition("f", 0), p->getDefinitions()[0]);
+    CHECK_EQUAL(p->getDefinition("f", 1), p->getDefinitions()[1]);
+    CHECK_EQUAL(p->getDefinition("f", 2), p->getDefinitions()[2]);
+    CHECK(!p->getDefinition("f", 3));
+    CHECK(!p->getDefinition("g"));
+}
+
 static const string functionVS =
     "void main()\n"
     "{\n"
@@ -84,3 +104,26 @@ TEST(CompileVectorConstructor) {
     CHECK_EQUAL(cr.fragmentShader, FS);
     
 }
+
+
+static const string branchingFunction =
+    "pick c v = if c then v else (v * 2.0)\n"
+    "gl_Position = vec4 (pick (gl_Vertex.x > 0.0) gl_Vertex.y) 0.0 0.0 1.0\n"
+    ;
+
+
+TEST(CompileBranchingFunction) {
+    static const string VS =
+        "void main()\n"
+        "{\n"
+        "  float _ren_r0 = gl_Vertex.y;\n"
+        "  float _ren_r1;\n"
+        "  if ((gl_Vertex.x > 0.0))\n"
+        "    _ren_r1 = _ren_r0;\n"
+        "  else\n"
+        "    _ren_r1 = (_ren_r0 * 2.0);\n"
+        "  gl_Position = vec4(_ren_r1, 0.0, 0.0, 1.0);\n"
+        "}\n"
+        ;
+    CHECK_COMPILE(branchingFunction, VS, "");
+}
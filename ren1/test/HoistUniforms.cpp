@@ -0,0 +1,63 @@
+#include <cmath>
+#include "TestPrologue.h"
+
+
+static const string source =
+    "uniform vec3 LightPosition\n"
+    "uniform float Scale\n"
+    "gl_Position = ftransform\n"
+    "l = normalize LightPosition\n"
+    "d = max (dot l gl_Normal) 0.0\n"
+    "gl_FragColor = gl_Color * (d * (Scale * 2.0))\n"
+    ;
+
+
+static bool isClose(float a, float b) {
+    return std::fabs(a - b) < 0.001f;
+}
+
+
+TEST(HoistUniforms) {
+    static string FS =
+        "uniform vec3 _ren_u0;\n"
+        "uniform float _ren_u1;\n"
+        "varying vec4 _ren_v0;\n"
+        "varying vec3 _ren_v1;\n"
+        "void main()\n"
+        "{\n"
+        "  gl_FragColor = (_ren_v0 * (max(dot(_ren_u0, _ren_v1), 0.0) * _ren_u1));\n"
+        "}\n"
+        ;
+
+    CompileOptions options;
+    options.hoistUniforms = true;
+    CompileResult cr = compile(source, options);
+    CHECK(cr.success);
+    CHECK_EQUAL(cr.fragmentShader, FS);
+    CHECK(cr.uniformProgram);
+    if (!cr.uniformProgram) {
+        return;
+    }
+
+    float lightPosition[] = { 3, 0, 4 };
+    float scale = 3;
+    UniformProgram::ValueMap uniforms;
+    uniforms["LightPosition"] = Value::create(VEC3, lightPosition);
+    uniforms["Scale"]         = Value::create(FLOAT, &scale);
+
+    UniformProgram::ValueMap derived;
+    cr.uniformProgram->evaluate(uniforms, derived);
+    CHECK_EQUAL(derived.size(), 2U);
+    CHECK(isClose(derived["_ren_u0"]->asFloatVec()[0], 0.6f));
+    CHECK(isClose(derived["_ren_u0"]->asFloatVec()[2], 0.8f));
+    CHECK(isClose(derived["_ren_u1"]->asFloat(), 6.0f));
+}
+
+
+TEST(HoistUniformsOff) {
+    // Without the option, the shaders compute everything themselves.
+    CompileResult cr = compile(source);
+    CHECK(cr.success);
+    CHECK(!cr.uniformProgram);
+    CHECK(cr.fragmentShader.find("normalize(LightPosition)") != string::npos);
+}
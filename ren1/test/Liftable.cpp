@@ -1,3 +1,4 @@
+#include <sstream>
 #include "TestPrologue.h"
 
 
@@ -23,3 +24,108 @@ TEST(Liftable) {
         ;
     CHECK_COMPILE(source, VS, FS);
 }
+
+
+static const string lighting =
+    "uniform vec3 LightPosition\n"
+    "ecPosition = (gl_ModelViewMatrix * gl_Vertex).xyz\n"
+    "lightVec = normalize (LightPosition - ecPosition)\n"
+    "viewVec = normalize (-ecPosition)\n"
+    "d = dot lightVec viewVec\n"
+    "gl_Position = ftransform\n"
+    "gl_FragColor = vec4 d d d 1.0\n"
+    ;
+
+
+TEST(VaryingBudget) {
+    // Both vectors derive from ecPosition, so one varying will do.
+    string VS =
+        "varying vec3 _ren_v0;\n"
+        "void main()\n"
+        "{\n"
+        "  gl_Position = ftransform();\n"
+        "  _ren_v0 = (gl_ModelViewMatrix * gl_Vertex).xyz;\n"
+        "}\n"
+        ;
+    string FS =
+        "uniform vec3 LightPosition;\n"
+        "varying vec3 _ren_v0;\n"
+        "void main()\n"
+        "{\n"
+        "  float _ren_r0 = dot(normalize((LightPosition - _ren_v0)), normalize((-_ren_v0)));\n"
+        "  gl_FragColor = vec4(_ren_r0, _ren_r0, _ren_r0, 1.0);\n"
+        "}\n"
+        ;
+
+    CompileOptions options;
+    CompileResult unlimited(compile(lighting, options));
+    CHECK(unlimited.success);
+    CHECK(unlimited.vertexShader.find("_ren_v1") != string::npos);
+
+    options.maxVaryings = 1;
+    CompileResult cr(compile(lighting, options));
+    CHECK(cr.success);
+    CHECK_EQUAL(VS, cr.vertexShader);
+    CHECK_EQUAL(FS, cr.fragmentShader);
+
+    options.maxVaryings = 0;
+    std::ostringstream errors;
+    CHECK(!compile(lighting, options, errors).success);
+}
+
+
+TEST(DenseMesh) {
+    // With more vertices than pixels, transforming per pixel is
+    // cheaper.
+    string VS =
+        "varying vec4 _ren_v0;\n"
+        "void main()\n"
+        "{\n"
+        "  gl_Position = ftransform();\n"
+        "  _ren_v0 = gl_Vertex;\n"
+        "}\n"
+        ;
+
+    CompileOptions options;
+    options.pixelsPerVertex = 0.5f;
+    CompileResult cr(compile(lighting, options));
+    CHECK(cr.success);
+    CHECK_EQUAL(VS, cr.vertexShader);
+}
+
+
+TEST(PackVaryings) {
+    string source =
+        "uniform sampler2D Texture\n"
+        "n = normalize (gl_NormalMatrix * gl_Normal)\n"
+        "fog = pow gl_Color.x 2.0\n"
+        "uv = gl_MultiTexCoord0.xy\n"
+        "gl_Position = ftransform\n"
+        "gl_FragColor = texture2D Texture uv * (dot n n * fog)\n"
+        ;
+
+    // The vec3 and the float share a vec4.
+    string VS =
+        "varying vec2 _ren_v0;\n"
+        "varying vec4 _ren_v1;\n"
+        "void main()\n"
+        "{\n"
+        "  gl_Position = ftransform();\n"
+        "  _ren_v0 = gl_MultiTexCoord0.xy;\n"
+        "  _ren_v1.xyz = (gl_NormalMatrix * gl_Normal);\n"
+        "  _ren_v1.w = gl_Color.x;\n"
+        "}\n"
+        ;
+    string FS =
+        "uniform sampler2D Texture;\n"
+        "varying vec2 _ren_v0;\n"
+        "varying vec4 _ren_v1;\n"
+        "void main()\n"
+        "{\n"
+        "  vec3 _ren_r0 = normalize(_ren_v1.xyz);\n"
+        "  gl_FragColor = (texture2D(Texture, _ren_v0) * (dot(_ren_r0, _ren_r0) * pow(_ren_v1.w, 2.0)));\n"
+        "}\n"
+        ;
+
+    CHECK_COMPILE(source, VS, FS);
+}
@@ -0,0 +1,56 @@
+#include <ren/Permutations.h>
+#include "TestPrologue.h"
+
+
+static const string source =
+    "constant bool Transform\n"
+    "constant bool Bright\n"
+    "foo = ftransform\n"
+    "bar = gl_ModelViewProjectionMatrix * gl_Vertex\n"
+    "gl_Position = if Transform then foo else bar\n"
+    "gl_FragColor = if Bright then vec4 1.0 1.0 1.0 1.0 else gl_Color\n"
+    ;
+
+
+TEST(BoolPermutations) {
+    std::vector<string> names;
+    names.push_back("A");
+    names.push_back("B");
+
+    ConstantMapList permutations = getBoolPermutations(names);
+    CHECK_EQUAL(permutations.size(), 4u);
+    CHECK(!permutations[0]["A"]->asBool());
+    CHECK( permutations[1]["A"]->asBool());
+    CHECK(!permutations[1]["B"]->asBool());
+    CHECK( permutations[3]["A"]->asBool());
+    CHECK( permutations[3]["B"]->asBool());
+}
+
+
+TEST(CompilePermutations) {
+    ProgramPtr p = parse(source);
+    CHECK(p);
+
+    std::vector<string> names;
+    names.push_back("Transform");
+    names.push_back("Bright");
+    ConstantMapList permutations = getBoolPermutations(names);
+
+    std::vector<CompileResult> results =
+        compilePermutations(p, permutations, CompileOptions(), 4);
+    CHECK_EQUAL(results.size(), permutations.size());
+
+    // Each matches a compile of its own, in order.
+    for (size_t i = 0; i < permutations.size(); ++i) {
+        ProgramPtr q = parse(source);
+        q->setConstantValues(permutations[i]);
+        CompileResult expected = compile(q);
+        CHECK(results[i].success);
+        CHECK_EQUAL(results[i].vertexShader, expected.vertexShader);
+        CHECK_EQUAL(results[i].fragmentShader, expected.fragmentShader);
+    }
+    CHECK(results[0].vertexShader != results[1].vertexShader);
+
+    // The shared program keeps its own values.
+    CHECK(!Bool(p, "Transform"));
+}
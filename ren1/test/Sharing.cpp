@@ -104,3 +104,32 @@ TEST(SharingOrder) {
     CHECK_EQUAL(cr.vertexShader,   VS);
     CHECK_EQUAL(cr.fragmentShader, FS);
 }
+
+
+TEST(StructuralSharing) {
+    string source =
+        "a = gl_Vertex.x\n"
+        "double x = x + x\n"
+        "x1 = gl_Vertex.y + 1.0\n"
+        "x2 = gl_Vertex.y + 1.0\n"
+        "gl_Position = vec4 (double a) (double a) a a\n"
+        ;
+
+    ProgramPtr p = parse(source);
+    CHECK(p);
+
+    CompilationContext cc(p);
+    CHECK_EQUAL(cc.evaluate("x1"), cc.evaluate("x2"));
+
+    string VS =
+        "void main()\n"
+        "{\n"
+        "  float _ren_r1 = gl_Vertex.x;\n"
+        "  float _ren_r0 = (_ren_r1 + _ren_r1);\n"
+        "  gl_Position = vec4(_ren_r0, _ren_r0, _ren_r1, _ren_r1);\n"
+        "}\n"
+        ;
+    string FS = "";
+
+    CHECK_COMPILE(source, VS, FS);
+}
@@ -55,3 +55,86 @@ TEST(Specialize) {
     condition = false;
     CHECK_COMPILE(p, VSfalse, FS);
 }
+
+
+TEST(EvaluateSpecialized) {
+    string source =
+        "constant bool condition\n"
+        "foo = ftransform\n"
+        "bar = gl_ModelViewProjectionMatrix * gl_Vertex\n"
+        "gl_Position = if condition then foo else bar\n"
+        ;
+
+    ProgramPtr p = parse(source);
+    CHECK(p);
+    Bool condition(p, "condition");
+    condition = true;
+
+    // The untaken arm is never turned into code.
+    CompilationContext cc(p);
+    CodeNodePtr pos = cc.evaluate("gl_Position");
+    REN_DYNAMIC_CAST_PTR(n, NameCodeNode, pos);
+    CHECK(n);
+    CHECK_EQUAL(n->getName(), "ftransform()");
+}
+
+
+TEST(SpecializeComputedCondition) {
+    string source =
+        "constant vec2 Detail\n"
+        "foo = ftransform\n"
+        "bar = gl_ModelViewProjectionMatrix * gl_Vertex\n"
+        "gl_Position = if Detail.x * 2.0 > 1.0 then foo else bar\n"
+        ;
+
+    string VShigh =
+        "void main()\n"
+        "{\n"
+        "  gl_Position = ftransform();\n"
+        "}\n"
+        ;
+
+    string VSlow =
+        "void main()\n"
+        "{\n"
+        "  gl_Position = (gl_ModelViewProjectionMatrix * gl_Vertex);\n"
+        "}\n"
+        ;
+
+    string FS = "";
+
+    ProgramPtr p = parse(source);
+    CHECK(p);
+    Vec2 detail(p, "Detail");
+
+    detail.set(1, 0);
+    CHECK_COMPILE(p, VShigh, FS);
+    detail.set(0.25f, 0);
+    CHECK_COMPILE(p, VSlow, FS);
+}
+
+
+TEST(FoldConstants) {
+    string source =
+        "uniform float Diffuse\n"
+        "uniform float Specular\n"
+        "DiffuseContribution = 0.0\n"
+        "SpecularContribution = 1.0\n"
+        "intensity = DiffuseContribution * Diffuse +"
+        " SpecularContribution * Specular\n"
+        "bias = (0.25 ++ 0.5) ++ (2.0 * 0.375)\n"
+        "gl_FragColor = (bias ++ 0.0) + (vec4 intensity intensity intensity 1.0)\n"
+        ;
+
+    // Diffuse no longer contributes, so it isn't declared either.
+    string VS = "";
+    string FS =
+        "uniform float Specular;\n"
+        "void main()\n"
+        "{\n"
+        "  gl_FragColor = (vec4(0.25, 0.5, 0.75, 0.0) + vec4(Specular, Specular, Specular, 1.0));\n"
+        "}\n"
+        ;
+
+    CHECK_COMPILE(source, VS, FS);
+}
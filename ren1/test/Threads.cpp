@@ -0,0 +1,100 @@
+#include <sstream>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <ren/Permutations.h>
+#include "TestPrologue.h"
+
+
+static const string source =
+    "constant bool Transform\n"
+    "constant bool Bright\n"
+    "uniform vec3 LightPosition\n"
+    "foo = ftransform\n"
+    "bar = gl_ModelViewProjectionMatrix * gl_Vertex\n"
+    "gl_Position = if Transform then foo else bar\n"
+    "d = max (dot (normalize LightPosition) gl_Normal) 0.0\n"
+    "c = if Bright then (gl_Color * 2.0) else gl_Color\n"
+    "gl_FragColor = c * d\n"
+    ;
+
+
+TEST(ConstantOverrides) {
+    ProgramPtr p = parse(source);
+    CHECK(p);
+
+    bool value = true;
+    CompileOptions options;
+    options.constants["Transform"] = Value::create(BOOL, &value);
+    CompileResult cr = compile(p, options);
+    CHECK(cr.success);
+    CHECK(cr.vertexShader.find("ftransform()") != string::npos);
+
+    // The program's own value is untouched.
+    CHECK(!Bool(p, "Transform"));
+
+    std::ostringstream errors;
+    options.constants["Missing"] = Value::create(BOOL, &value);
+    CHECK(!compile(p, options, errors).success);
+}
+
+
+/// Compiles the shared program, and programs of its own, over and
+/// over, counting results that differ from the serial ones.
+static void stress(
+    ProgramPtr shared,
+    const ConstantMapList* permutations,
+    const std::vector<CompileResult>* expected,
+    size_t seed,
+    size_t* failures
+) {
+    for (size_t i = 0; i < 20; ++i) {
+        size_t p = (seed + i) % permutations->size();
+
+        CompileOptions options;
+        options.constants = (*permutations)[p];
+
+        // Every other time, parse a program of its own.
+        ProgramPtr program = (i % 2 ? parse(source) : shared);
+
+        std::ostringstream output;
+        CompileResult cr = compile(program, options, output);
+        if (!cr.success ||
+            cr.vertexShader != (*expected)[p].vertexShader ||
+            cr.fragmentShader != (*expected)[p].fragmentShader
+        ) {
+            ++*failures;
+        }
+    }
+}
+
+
+// Also run under ThreadSanitizer by 'scons tsan=1 test'.
+TEST(ConcurrentCompiles) {
+    ProgramPtr p = parse(source);
+    CHECK(p);
+
+    std::vector<string> names;
+    names.push_back("Transform");
+    names.push_back("Bright");
+    ConstantMapList permutations = getBoolPermutations(names);
+
+    std::vector<CompileResult> expected;
+    for (size_t i = 0; i < permutations.size(); ++i) {
+        CompileOptions options;
+        options.constants = permutations[i];
+        expected.push_back(compile(p, options));
+    }
+
+    const size_t THREADS = 8;
+    std::vector<size_t> failures(THREADS);
+    boost::thread_group threads;
+    for (size_t t = 0; t < THREADS; ++t) {
+        threads.create_thread(boost::bind(
+            stress, p, &permutations, &expected, t, &failures[t]));
+    }
+    threads.join_all();
+
+    for (size_t t = 0; t < THREADS; ++t) {
+        CHECK_EQUAL(failures[t], 0u);
+    }
+}
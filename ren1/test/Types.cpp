@@ -85,3 +85,18 @@ TEST(Functions) {
     CHECK_EQUAL(f2.in,  NullType);
     CHECK_EQUAL(f2.out, INT);
 }
+
+
+TEST(Interning) {
+    // Equal types share one object, however they were built.
+    TypeList tl;
+    tl.push_back(INT);
+    tl.push_back(FLOAT * BOOL);
+    CHECK(makeTuple(tl).get() == (INT * FLOAT * BOOL).get());
+    CHECK((VEC4 >> FLOAT).get() == (VEC4 >> FLOAT).get());
+    CHECK_EQUAL((VEC4 >> FLOAT).getId(), (VEC4 >> FLOAT).getId());
+
+    CHECK((INT >> FLOAT) != (FLOAT >> INT));
+    CHECK((INT * FLOAT) != (FLOAT * INT));
+    CHECK((INT >> FLOAT).getId() != (FLOAT >> INT).getId());
+}
@@ -44,3 +44,50 @@ TEST(UniformsCompile) {
     CHECK_EQUAL(cr.vertexShader,   VS);
     CHECK_EQUAL(cr.fragmentShader, FS);
 }
+
+
+TEST(PackUniforms) {
+    static string source =
+        "uniform float Shininess\n"
+        "uniform vec3  Color\n"
+        "uniform vec2  Offset\n"
+        "uniform sampler2D Texture\n"
+        "gl_FragColor = (Color ++ Shininess) +"
+        " texture2D Texture Offset\n"
+        ;
+
+    ProgramPtr p = parse(source);
+    CHECK(p);
+
+    // Color starts a new vec4.  A vec2 starts on an even component,
+    // so Offset can't take the float Color leaves over.
+    const UniformLayout& layout = p->getUniformLayout();
+    CHECK_EQUAL(layout.getEntries().size(), 3u);
+    CHECK_EQUAL(layout.find("Shininess")->offset, 0u);
+    CHECK_EQUAL(layout.find("Color")->offset, 4u);
+    CHECK_EQUAL(layout.find("Offset")->offset, 8u);
+    CHECK(!layout.find("Texture"));
+    CHECK_EQUAL(layout.getSize(), 12u);
+
+    Vec3 color(p, "Color");
+    color.set(0.25f, 0.5f, 0.75f);
+    CHECK_EQUAL(p->getUniformBuffer()[4], 0.25f);
+    CHECK_EQUAL(p->getUniformBuffer()[6], 0.75f);
+
+    static string FS =
+        "uniform sampler2D Texture;\n"
+        "uniform vec4 _ren_uniforms[3];\n"
+        "void main()\n"
+        "{\n"
+        "  gl_FragColor = (vec4(_ren_uniforms[1].xyz, _ren_uniforms[0].x)"
+        " + texture2D(Texture, _ren_uniforms[2].xy));\n"
+        "}\n";
+
+    CompileOptions options;
+    options.packUniforms = true;
+    CompileResult cr = compile(p, options);
+    CHECK(cr.success);
+    CHECK_EQUAL(cr.vertexShader, "");
+    CHECK_EQUAL(cr.fragmentShader, FS);
+    CHECK_EQUAL(cr.uniformLayout.getEntries().size(), 3u);
+}
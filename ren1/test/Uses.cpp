@@ -0,0 +1,67 @@
+#include "TestPrologue.h"
+
+
+static CodeNodePtr makeName(
+    const string& name,
+    Frequency frequency = UNIFORM
+) {
+    return CodeNodePtr(new NameCodeNode(
+                           name, FLOAT, frequency, NullValue,
+                           ValueNode::UNIFORM));
+}
+
+
+static CodeNodePtr makeAdd(CodeNodePtr lhs, CodeNodePtr rhs) {
+    CodeNodeList args(2);
+    args[0] = lhs;
+    args[1] = rhs;
+    return CodeNodePtr(new CallCodeNode(
+                           FLOAT, FunctionNode::INFIX, "+", args, LINEAR));
+}
+
+
+TEST(Uses) {
+    CodeNodePtr a = makeName("a");
+    CodeNodePtr b = makeName("b");
+    CodeNodePtr sum = makeAdd(a, a);
+
+    CHECK_EQUAL(a->getUsers().size(), 2U);
+    CHECK_EQUAL(sum->getUsers().size(), 0U);
+
+    AssignmentPtr s(new Assignment);
+    s->define = false;
+    s->lhs = "x";
+    s->setExpression(sum);
+    CHECK_EQUAL(sum->getUsers().size(), 1U);
+
+    replaceUses(a, b);
+    CHECK_EQUAL(a->getUsers().size(), 0U);
+    CHECK_EQUAL(b->getUsers().size(), 2U);
+    CHECK_EQUAL(sum->asExpression(), "(b + b)");
+
+    replaceUses(sum, b);
+    CHECK_EQUAL(s->getExpression(), b);
+    CHECK_EQUAL(sum->getUsers().size(), 0U);
+    CHECK_EQUAL(b->getUsers().size(), 3U);
+
+    // Destroying a user unregisters it.
+    sum.reset();
+    CHECK_EQUAL(b->getUsers().size(), 1U);
+    s.reset();
+    CHECK_EQUAL(b->getUsers().size(), 0U);
+}
+
+
+TEST(UpdateFrequency) {
+    CodeNodePtr a = makeName("a");
+    CodeNodePtr sum = makeAdd(a, a);
+    CodeNodePtr product = makeAdd(sum, makeName("c", CONSTANT));
+    CHECK_EQUAL(product->getFrequency(), UNIFORM);
+    CHECK(product->canInterpolate());
+
+    // Attributes cached by users follow a replaced child.
+    replaceUses(a, makeName("f", FRAGMENT));
+    CHECK_EQUAL(sum->getFrequency(), FRAGMENT);
+    CHECK_EQUAL(product->getFrequency(), FRAGMENT);
+    CHECK(!product->canInterpolate());
+}
@@ -0,0 +1,154 @@
+#include <sstream>
+#include <ren/VariantCache.h>
+#include "TestPrologue.h"
+
+
+static const string source =
+    "constant bool Transform\n"
+    "constant bool Unused\n"
+    "foo = ftransform\n"
+    "bar = gl_ModelViewProjectionMatrix * gl_Vertex\n"
+    "gl_Position = if Transform then foo else bar\n"
+    ;
+
+
+TEST(VariantCacheHits) {
+    ProgramPtr p = parse(source);
+    CHECK(p);
+    Bool transform(p, "Transform");
+
+    VariantCache cache;
+    CompileResultPtr a = cache.get(p);
+    CHECK(a && a->success);
+    CHECK(cache.get(p) == a);
+
+    transform = true;
+    CompileResultPtr b = cache.get(p);
+    CHECK(b != a);
+    CHECK_EQUAL(b->vertexShader,
+                "void main()\n"
+                "{\n"
+                "  gl_Position = ftransform();\n"
+                "}\n");
+
+    transform = false;
+    CHECK(cache.get(p) == a);
+
+    CHECK_EQUAL(cache.getHits(), 2u);
+    CHECK_EQUAL(cache.getMisses(), 2u);
+    CHECK_EQUAL(cache.getEvictions(), 0u);
+}
+
+
+TEST(VariantCacheSharesResults) {
+    ProgramPtr p = parse(source);
+    CHECK(p);
+    Bool unused(p, "Unused");
+
+    VariantCache cache;
+    CompileResultPtr a = cache.get(p);
+    unused = true;
+    CHECK(cache.get(p) == a);
+    CHECK_EQUAL(cache.getVariantCount(), 2u);
+    CHECK_EQUAL(cache.getResultCount(), 1u);
+    CHECK_EQUAL(cache.getMisses(), 2u);
+}
+
+
+TEST(VariantCacheEvicts) {
+    ProgramPtr p = parse(source);
+    CHECK(p);
+    Bool transform(p, "Transform");
+
+    // Only the result just asked for is kept.
+    VariantCache cache(0);
+    cache.get(p);
+    transform = true;
+    cache.get(p);
+    CHECK_EQUAL(cache.getVariantCount(), 1u);
+    CHECK_EQUAL(cache.getEvictions(), 1u);
+
+    transform = false;
+    cache.get(p);
+    CHECK_EQUAL(cache.getMisses(), 3u);
+    CHECK_EQUAL(cache.getEvictions(), 2u);
+
+    cache.setBudget(1024 * 1024);
+    transform = true;
+    cache.get(p);
+    CHECK_EQUAL(cache.getVariantCount(), 2u);
+    CHECK(cache.getBytesUsed() > 0u);
+
+    cache.clear();
+    CHECK_EQUAL(cache.getVariantCount(), 0u);
+    CHECK_EQUAL(cache.getBytesUsed(), 0u);
+}
+
+
+TEST(VariantCacheFillsInBackground) {
+    ProgramPtr p = parse(source);
+    CHECK(p);
+    Bool transform(p, "Transform");
+
+    CompileQueue queue(1);
+    VariantCache cache(0);
+    CompileResultPtr a = cache.get(p);
+
+    transform = true;
+    CompileResultPtr b;
+    while (!(b = cache.getAsync(p, queue))) {
+        boost::thread::yield();
+    }
+    CHECK(!cache.isPending(p));
+    CHECK(b->success);
+    CHECK(b != a);
+
+    // Queued compiles count, and are evicted, like the others.
+    CHECK_EQUAL(cache.getMisses(), 2u);
+    CHECK_EQUAL(cache.getEvictions(), 1u);
+    CHECK_EQUAL(cache.getVariantCount(), 1u);
+    CHECK_EQUAL(cache.getPendingCount(), 0u);
+
+    // get() waits for a queued compile instead of compiling again.
+    transform = false;
+    CHECK(!cache.getAsync(p, queue));
+    CHECK_EQUAL(cache.get(p)->vertexShader, a->vertexShader);
+    CHECK_EQUAL(cache.getMisses(), 3u);
+    CHECK_EQUAL(cache.getPendingCount(), 0u);
+}
+
+
+TEST(VariantCacheKeepsSuccess) {
+    // Neither has any shader text, but only one compiles.
+    ProgramPtr failed = parse("gl_Position = 1.0\n");
+    ProgramPtr empty = parse("foo = 1.0\n");
+    CHECK(failed && empty);
+
+    std::ostringstream errors;
+    VariantCache cache;
+    CHECK(!cache.get(failed, errors)->success);
+    CHECK(cache.get(empty)->success);
+    CHECK_EQUAL(cache.getResultCount(), 2u);
+}
+
+
+TEST(VariantCacheKeepsUniformLayouts) {
+    // Packed, both programs compile to the same text.
+    ProgramPtr a = parse(
+        "uniform float A\n"
+        "gl_FragColor = vec4 A A A 1.0\n");
+    ProgramPtr b = parse(
+        "uniform float B\n"
+        "gl_FragColor = vec4 B B B 1.0\n");
+    CHECK(a && b);
+
+    CompileOptions options;
+    options.packUniforms = true;
+    VariantCache cache(16 * 1024 * 1024, options);
+    CompileResultPtr ra = cache.get(a);
+    CompileResultPtr rb = cache.get(b);
+    CHECK_EQUAL(ra->fragmentShader, rb->fragmentShader);
+    CHECK(ra->uniformLayout.find("A"));
+    CHECK(rb->uniformLayout.find("B"));
+    CHECK_EQUAL(cache.getResultCount(), 2u);
+}
@@ -12,7 +12,7 @@ TEST(VectorConcatenation) {
     const string VS =
         "void main()\n"
         "{\n"
-        "  gl_Position = vec4(vec3(vec2(0.0, 0.0), 0.0), 0.0);\n"
+        "  gl_Position = vec4(0.0, 0.0, 0.0, 0.0);\n"
         "}\n"
         ;
     const string FS = "";
@@ -27,18 +27,13 @@ TEST(Regression) {
         "gl_FragColor = color ++ 0.0\n"
         ;
 
-    const string VS =
-        "varying vec3 _ren_v0;\n"
-        "void main()\n"
-        "{\n"
-        "  _ren_v0 = vec3(0.0, 0.0, 0.0);\n"
-        "}\n"
-        ;
+    // The constant concatenation is folded, so nothing's left to
+    // interpolate.
+    const string VS = "";
     const string FS =
-        "varying vec3 _ren_v0;\n"
         "void main()\n"
         "{\n"
-        "  gl_FragColor = vec4(_ren_v0, 0.0);\n"
+        "  gl_FragColor = vec4(0.0, 0.0, 0.0, 0.0);\n"
         "}\n"
         ;
 
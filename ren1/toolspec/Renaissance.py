@@ -3,5 +3,11 @@ def generate(env):
                LIBPATH=['#/stage/lib'],
                LIBS=['ren', 'antlr'])
 
+    # ren compiles permutations on threads of its own.  Windows links
+    # Boost.Thread automatically.
+    if env['PLATFORM'] != 'win32':
+        env.Append(LIBS=['boost_thread-gcc-mt'],
+                   LINKFLAGS=['-pthread'])
+
 def exists(env):
     return 1